@@ -24,20 +24,18 @@ DNSDomainName::DNSDomainName(std::string fullyQualifiedDomainName) {
 }
 
 DNSSerializationBuffer DNSDomainName::serialize(void) {
-    DNSSerializationBuffer buffer;
-    for (std::string component : components) {
-        buffer.serializeDNSLabel(component);
-    }
-    return buffer;
+    return DNSSerializationBuffer::from(*this);
+}
+
+void DNSDomainName::serialize(DNSWireWriter& writer) {
+    writer.writeDNSName(components);
 }
 
+// through a view, which can follow compression pointers into the rest of the packet
 DNSDomainName DNSDomainName::deserialize(DNSDeserializationBuffer& buffer) {
-    DNSDomainName domainName;
-    std::string label;
-    do {
-        label = buffer.deserializeDNSLabel();
-        domainName.components.push_back(label);
-    } while (label.length() > 0);
+    DNSWireReader reader = buffer.reader();
+    DNSDomainName domainName = fromView(DNSNameView::deserialize(reader));
+    buffer.skip(reader.offset() - buffer.reader().offset());
     return domainName;
 }
 
@@ -48,6 +46,15 @@ DNSDomainName DNSDomainName::fromString(std::string domainName) {
     return DNSDomainName(domainName);
 }
 
+DNSDomainName DNSDomainName::fromView(const DNSNameView& view) {
+    DNSDomainName domainName;
+    view.forEachLabel([&](std::string_view label) {
+        domainName.components.emplace_back(label);
+    });
+    domainName.components.push_back(""); // root
+    return domainName;
+}
+
 std::string DNSDomainName::toString(void) const {
     std::string stringified;
     for (const auto& component : components | std::ranges::views::take(components.size() - 1)) {
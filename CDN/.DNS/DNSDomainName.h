@@ -9,6 +9,8 @@
 
 #include "Serialization/DNSSerializationBuffer.h"
 #include "Serialization/DNSDeserializationBuffer.h"
+#include "Serialization/DNSWireWriter.h"
+#include "DNSNameView.h"
 
 class DNSDomainName {
 private:
@@ -18,9 +20,11 @@ private:
 public:
     DNSDomainName() = default;
     static DNSDomainName fromString(std::string domainName);
+    static DNSDomainName fromView(const DNSNameView& view);
     std::string toString(void) const;
 
     DNSSerializationBuffer serialize(void);
+    void serialize(DNSWireWriter& writer);
     static DNSDomainName deserialize(DNSDeserializationBuffer& buffer);
 
     bool operator==(const DNSDomainName& other) const;
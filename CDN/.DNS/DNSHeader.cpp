@@ -7,39 +7,43 @@
 #include "Serialization/DNSDeserializationBuffer.h"
 
 DNSSerializationBuffer DNSHeader::serialize(void) {
+    return DNSSerializationBuffer::from(*this);
+}
 
-    DNSSerializationBuffer buffer;
-
-    buffer.serializeUInt16(ID);
+void DNSHeader::serialize(DNSWireWriter& writer) {
+    writer.writeUInt16(ID);
     uint8_t byte1 = (QR << 7) | (static_cast<uint8_t>(OPCODE) << 3) | (AA << 2) | (TC << 1) | RD;
-    buffer.serializeUInt8(byte1);
+    writer.writeUInt8(byte1);
     uint8_t byte2 = (RA << 7) | (Z << 4) | static_cast<uint8_t>(RCODE);
-    buffer.serializeUInt8(byte2);
-    buffer.serializeUInt16(QDCOUNT);
-    buffer.serializeUInt16(ANCOUNT);
-    buffer.serializeUInt16(NSCOUNT);
-    buffer.serializeUInt16(ARCOUNT);
-
-    return buffer;
+    writer.writeUInt8(byte2);
+    writer.writeUInt16(QDCOUNT);
+    writer.writeUInt16(ANCOUNT);
+    writer.writeUInt16(NSCOUNT);
+    writer.writeUInt16(ARCOUNT);
 }
 
-DNSHeader DNSHeader::deserialize(DNSDeserializationBuffer& buffer) {
-
-    DNSHeader header;
-
-    header.ID = buffer.deserializeUInt16();
-    uint8_t byte1 = buffer.deserializeUInt8();
+// the two flag bytes, the same for both readers
+static void deserializeFlags(DNSHeader& header, uint8_t byte1, uint8_t byte2) {
     header.QR = (byte1 >> 7) & 0x01;
     header.OPCODE = static_cast<DNSOpcode>((byte1 >> 3) & 0x0F);
     header.AA = (byte1 >> 2) & 0x01;
     header.TC = (byte1 >> 1) & 0x01;
     header.RD = byte1 & 0x01;
-    uint8_t byte2 = buffer.deserializeUInt8();
     header.RA = (byte2 >> 7) & 0x01;
     header.Z = (byte2 >> 6) & 0x1;
     header.AD = (byte2 >> 5) & 0x1;
     header.CD = (byte2 >> 4) & 0x1;
     header.RCODE = static_cast<DNSRcode>(byte2 & 0x0F);
+}
+
+DNSHeader DNSHeader::deserialize(DNSDeserializationBuffer& buffer) {
+
+    DNSHeader header;
+
+    header.ID = buffer.deserializeUInt16();
+    uint8_t byte1 = buffer.deserializeUInt8();
+    uint8_t byte2 = buffer.deserializeUInt8();
+    deserializeFlags(header, byte1, byte2);
     header.QDCOUNT = buffer.deserializeUInt16();
     header.ANCOUNT = buffer.deserializeUInt16();
     header.NSCOUNT = buffer.deserializeUInt16();
@@ -47,3 +51,19 @@ DNSHeader DNSHeader::deserialize(DNSDeserializationBuffer& buffer) {
 
     return header;
 }
+
+DNSHeader DNSHeader::deserialize(DNSWireReader& reader) {
+
+    DNSHeader header;
+
+    header.ID = reader.readUInt16();
+    uint8_t byte1 = reader.readUInt8();
+    uint8_t byte2 = reader.readUInt8();
+    deserializeFlags(header, byte1, byte2);
+    header.QDCOUNT = reader.readUInt16();
+    header.ANCOUNT = reader.readUInt16();
+    header.NSCOUNT = reader.readUInt16();
+    header.ARCOUNT = reader.readUInt16();
+
+    return header;
+}
@@ -9,6 +9,8 @@
 
 #include "Serialization/DNSSerializationBuffer.h"
 #include "Serialization/DNSDeserializationBuffer.h"
+#include "Serialization/DNSWireReader.h"
+#include "Serialization/DNSWireWriter.h"
 
 enum class DNSOpcode : uint8_t {
     QUERY = 0,
@@ -46,7 +48,9 @@ struct DNSHeader {
     uint16_t ARCOUNT;
 
     DNSSerializationBuffer serialize(void);
+    void serialize(DNSWireWriter& writer);
     static DNSHeader deserialize(DNSDeserializationBuffer& buffer);
+    static DNSHeader deserialize(DNSWireReader& reader);
 };
 
 #endif /* B50533DD_C23C_43DD_BE78_797750A2C96D */
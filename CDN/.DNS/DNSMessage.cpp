@@ -3,30 +3,66 @@
 #include <ranges>
 
 #include "DNSMessage.h"
+#include "DNSMessageView.h"
 #include "Serialization/DNSSerializationBuffer.h"
 #include "Serialization/DNSDeserializationBuffer.h"
 
 std::vector<std::byte> DNSMessage::serialize(void) {
+    thread_local std::byte bytes[MAX_SIZE];
+    size_t length = serialize(std::span(bytes));
+    return std::vector<std::byte>(bytes, bytes + length);
+}
+
+size_t DNSMessage::serialize(std::span<std::byte> out) {
 
-    DNSSerializationBuffer buffer;
+    DNSWireWriter writer(out);
 
-    buffer.concat(header.serialize());
-    buffer.concat(question.serialize());
-    for (DNSResourceRecord answer : answers) {
-        buffer.concat(answer.serialize());
+    header.serialize(writer);
+    question.serialize(writer);
+    for (DNSResourceRecord& answer : answers) {
+        answer.serialize(writer);
     }
 
-    return buffer.data();
+    return writer.size();
 }
 
+// an owning copy of what DNSMessageView parsed, only A and AAAA records are understood
 DNSMessage DNSMessage::deserialize(std::span<const std::byte> data) {
 
-    DNSDeserializationBuffer buffer(data);
+    DNSMessageView view = DNSMessageView::deserialize(data);
     DNSMessage message;
-    message.header = DNSHeader::deserialize(buffer);
-    message.question = DNSQuestion::deserialize(buffer);
+    message.header = view.header;
+    message.question.QNAME = DNSDomainName::fromView(view.question.QNAME);
+    message.question.QTYPE = view.question.QTYPE;
+    message.question.QCLASS = view.question.QCLASS;
+
+    DNSWireReader answers = view.answers();
     for (int i = 0; i < message.header.ANCOUNT; i++) {
-        message.answers.push_back(DNSResourceRecord::deserialize(buffer));
+        DNSResourceRecordView record = DNSResourceRecordView::deserialize(answers);
+        DNSResourceRecord answer;
+        answer.NAME = DNSDomainName::fromView(record.NAME);
+        answer.TYPE = record.TYPE;
+        answer.CLASS = record.CLASS;
+        answer.TTL = record.TTL;
+        answer.RDLENGTH = record.RDLENGTH;
+        DNSWireReader rdata(record.RDATA);
+        switch (record.TYPE) {
+            case DNSRRType::A: {
+                DNSResourceRecord::RecordDataTypes::A address;
+                address.ipv4Address = rdata.readUInt32();
+                answer.RDATA = address;
+                break;
+            }
+            case DNSRRType::AAAA: {
+                DNSResourceRecord::RecordDataTypes::AAAA address;
+                address.ipv6Address = rdata.readUInt128();
+                answer.RDATA = address;
+                break;
+            }
+            default:
+                throw std::runtime_error("Not implemented");
+        }
+        message.answers.push_back(answer);
     }
 
     return message;
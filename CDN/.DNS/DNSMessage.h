@@ -7,13 +7,19 @@
 #include "DNSHeader.h"
 #include "DNSQuestion.h"
 #include "DNSResourceRecord.h"
+#include "Serialization/DNSWireWriter.h"
 
 struct DNSMessage {
+    // the most a message can take, the largest a UDP datagram can carry
+    static constexpr size_t MAX_SIZE = 65535;
+
     DNSHeader header;
     DNSQuestion question;
     std::vector<DNSResourceRecord> answers;
 
     std::vector<std::byte> serialize(void);
+    // write into out without allocating, returns the length; NotEnoughSpaceException if it does not fit
+    size_t serialize(std::span<std::byte> out);
     static DNSMessage deserialize(std::span<const std::byte> data);
 };
 
@@ -0,0 +1,41 @@
+#include "DNSMessageView.h"
+
+DNSQuestionView DNSQuestionView::deserialize(DNSWireReader& reader) {
+
+    DNSQuestionView question;
+
+    question.QNAME = DNSNameView::deserialize(reader);
+    question.QTYPE = static_cast<DNSQType>(reader.readUInt16());
+    question.QCLASS = static_cast<DNSQClass>(reader.readUInt16());
+
+    return question;
+}
+
+DNSResourceRecordView DNSResourceRecordView::deserialize(DNSWireReader& reader) {
+
+    DNSResourceRecordView record;
+
+    record.NAME = DNSNameView::deserialize(reader);
+    record.TYPE = static_cast<DNSRRType>(reader.readUInt16());
+    record.CLASS = static_cast<DNSRRClass>(reader.readUInt16());
+    record.TTL = reader.readUInt32();
+    record.RDLENGTH = reader.readUInt16();
+    record.RDATA = reader.readBytes(record.RDLENGTH);
+
+    return record;
+}
+
+DNSMessageView DNSMessageView::deserialize(std::span<const std::byte> data) {
+
+    DNSWireReader reader(data);
+    DNSMessageView message;
+    message.packet = data;
+    message.header = DNSHeader::deserialize(reader);
+    message.question = DNSQuestionView::deserialize(reader);
+    message.answersOffset = reader.offset();
+    for (int i = 0; i < message.header.ANCOUNT; i++) {
+        DNSResourceRecordView::deserialize(reader);
+    }
+
+    return message;
+}
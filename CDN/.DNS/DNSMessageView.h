@@ -0,0 +1,50 @@
+#ifndef EC92723C_9C5E_4CBB_B096_DC632D92D688
+#define EC92723C_9C5E_4CBB_B096_DC632D92D688
+
+#include <span>
+
+#include "DNSHeader.h"
+#include "DNSNameView.h"
+#include "DNSQuestion.h"
+#include "DNSResourceRecord.h"
+#include "Serialization/DNSWireReader.h"
+
+// Parsing without owning anything: the views below point into the packet they were read from,
+// which has to outlive them. DNSMessage::deserialize copies out of these.
+
+struct DNSQuestionView {
+    DNSNameView QNAME;
+    DNSQType QTYPE;
+    DNSQClass QCLASS;
+
+    static DNSQuestionView deserialize(DNSWireReader& reader);
+};
+
+// any record type, RDATA is the raw RDLENGTH bytes
+struct DNSResourceRecordView {
+    DNSNameView NAME;
+    DNSRRType TYPE;
+    DNSRRClass CLASS;
+    uint32_t TTL;
+    uint16_t RDLENGTH;
+    std::span<const std::byte> RDATA;
+
+    static DNSResourceRecordView deserialize(DNSWireReader& reader);
+};
+
+struct DNSMessageView {
+    DNSHeader header;
+    DNSQuestionView question;
+
+    // every answer is checked to be complete here, reading them again through answers() cannot fail
+    static DNSMessageView deserialize(std::span<const std::byte> data);
+
+    // a reader at the first of the header.ANCOUNT answers
+    DNSWireReader answers(void) const { return DNSWireReader(packet, answersOffset); }
+
+private:
+    std::span<const std::byte> packet;
+    size_t answersOffset = 0;
+};
+
+#endif /* EC92723C_9C5E_4CBB_B096_DC632D92D688 */
@@ -0,0 +1,75 @@
+#include "DNSNameView.h"
+
+DNSNameView DNSNameView::deserialize(DNSWireReader& reader) {
+    DNSNameView name;
+    name.packet = reader.data();
+    name.offset = reader.offset();
+
+    // walk a copy, the reader itself only moves past the bytes of the name that are in place
+    DNSWireReader labels = reader;
+    size_t nameLength = 0;
+    bool jumped = false;
+    while (true) {
+        size_t position = labels.offset();
+        uint8_t length = labels.readUInt8();
+        if ((length & 0xC0) == 0xC0) {
+            size_t target = ((length & 0x3F) << 8) | labels.readUInt8();
+            if (target >= position) {
+                throw MalformedNameException();
+            }
+            if (!jumped) {
+                reader = labels;
+                jumped = true;
+            }
+            labels = DNSWireReader(name.packet, target);
+            continue;
+        }
+        if (length > 63) {
+            throw MalformedNameException();
+        }
+        nameLength += 1 + length;
+        if (nameLength > MAX_LENGTH) {
+            throw MalformedNameException();
+        }
+        labels.readBytes(length);
+        if (length == 0) {
+            break;
+        }
+    }
+    if (!jumped) {
+        reader = labels;
+    }
+    return name;
+}
+
+std::string DNSNameView::toString(void) const {
+    std::string stringified;
+    forEachLabel([&](std::string_view label) {
+        stringified.append(label).append(".");
+    });
+    return stringified;
+}
+
+bool DNSNameView::matches(std::string_view domainName) const {
+    std::string_view rest = domainName;
+    if (rest.ends_with(".")) {
+        rest.remove_suffix(1);
+    }
+    bool equal = true;
+    bool more = !rest.empty();
+    forEachLabel([&](std::string_view label) {
+        if (!equal || !more) {
+            equal = false;
+            return;
+        }
+        size_t dot = rest.find('.');
+        if (rest.substr(0, dot) != label) {
+            equal = false;
+        } else if (dot == std::string_view::npos) {
+            more = false;
+        } else {
+            rest.remove_prefix(dot + 1);
+        }
+    });
+    return equal && !more;
+}
@@ -0,0 +1,53 @@
+#ifndef E1942638_A2D3_4186_B7EC_05E05B7DD128
+#define E1942638_A2D3_4186_B7EC_05E05B7DD128
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "Serialization/DNSWireReader.h"
+
+// A domain name inside a received packet. The labels are not copied, they are read from the packet
+// when asked for, so a view is only valid as long as the packet it came from. Compression pointers
+// (RFC 1035 4.1.4) are followed, deserialize() has made sure they lead somewhere.
+class DNSNameView {
+private:
+    std::span<const std::byte> packet;
+    size_t offset = 0;
+
+public:
+    DNSNameView() = default;
+
+    static constexpr size_t MAX_LENGTH = 255;
+
+    // The name at the reader's position, checked to be complete before the reader moves past it.
+    // A pointer has to point before itself, which together with MAX_LENGTH rules out loops;
+    // otherwise MalformedNameException.
+    static DNSNameView deserialize(DNSWireReader& reader);
+
+    // calls visit(std::string_view) for every label in order, the root label excluded
+    template <typename Visitor>
+    void forEachLabel(Visitor visit) const {
+        size_t position = offset;
+        while (true) {
+            uint8_t length = static_cast<uint8_t>(packet[position]);
+            if ((length & 0xC0) == 0xC0) {
+                position = ((length & 0x3F) << 8) | static_cast<uint8_t>(packet[position + 1]);
+                continue;
+            }
+            if (length == 0) {
+                return;
+            }
+            visit(std::string_view(reinterpret_cast<const char*>(packet.data() + position + 1), length));
+            position += 1 + length;
+        }
+    }
+
+    // same text as DNSDomainName::toString, with the trailing dot
+    std::string toString(void) const;
+    // whether this is domainName (dot separated, the trailing dot optional), without allocating
+    bool matches(std::string_view domainName) const;
+};
+
+#endif /* E1942638_A2D3_4186_B7EC_05E05B7DD128 */
@@ -9,13 +9,13 @@
 #include "Serialization/DNSDeserializationBuffer.h"
 
 DNSSerializationBuffer DNSQuestion::serialize(void) {
-    DNSSerializationBuffer result;
-
-    result.concat(QNAME.serialize());
-    result.serializeUInt16(static_cast<uint16_t>(QTYPE));
-    result.serializeUInt16(static_cast<uint16_t>(QCLASS));
+    return DNSSerializationBuffer::from(*this);
+}
 
-    return result;
+void DNSQuestion::serialize(DNSWireWriter& writer) {
+    QNAME.serialize(writer);
+    writer.writeUInt16(static_cast<uint16_t>(QTYPE));
+    writer.writeUInt16(static_cast<uint16_t>(QCLASS));
 }
 
 DNSQuestion DNSQuestion::deserialize(DNSDeserializationBuffer& buffer) {
@@ -10,6 +10,7 @@
 #include "DNSDomainName.h"
 #include "Serialization/DNSSerializationBuffer.h"
 #include "Serialization/DNSDeserializationBuffer.h"
+#include "Serialization/DNSWireWriter.h"
 
 enum class DNSQType : uint16_t {
 	A = 1,
@@ -66,6 +67,7 @@ struct DNSQuestion {
 	DNSQClass QCLASS;
 
     DNSSerializationBuffer serialize(void);
+    void serialize(DNSWireWriter& writer);
     static DNSQuestion deserialize(DNSDeserializationBuffer& buffer);
 };
 
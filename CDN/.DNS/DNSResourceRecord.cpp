@@ -6,28 +6,28 @@
 #include "Serialization/DNSDeserializationBuffer.h"
 
 DNSSerializationBuffer DNSResourceRecord::serialize(void) {
+    return DNSSerializationBuffer::from(*this);
+}
 
-    DNSSerializationBuffer buffer;
+void DNSResourceRecord::serialize(DNSWireWriter& writer) {
 
-    buffer.concat(NAME.serialize());
-    buffer.serializeUInt16(static_cast<uint16_t>(TYPE));
-    buffer.serializeUInt16(static_cast<uint16_t>(CLASS));
-    buffer.serializeUInt32(TTL);
-    buffer.serializeUInt16(RDLENGTH);
+    NAME.serialize(writer);
+    writer.writeUInt16(static_cast<uint16_t>(TYPE));
+    writer.writeUInt16(static_cast<uint16_t>(CLASS));
+    writer.writeUInt32(TTL);
+    writer.writeUInt16(RDLENGTH);
 
     switch (TYPE) {
         case DNSRRType::A: {
-            buffer.concat(std::get<DNSResourceRecord::RecordDataTypes::A>(RDATA).serialize());
+            std::get<DNSResourceRecord::RecordDataTypes::A>(RDATA).serialize(writer);
             break;
         }
         case DNSRRType::AAAA:
-            buffer.concat(std::get<DNSResourceRecord::RecordDataTypes::AAAA>(RDATA).serialize());
+            std::get<DNSResourceRecord::RecordDataTypes::AAAA>(RDATA).serialize(writer);
             break;
         default:
             throw std::runtime_error("Not implemented");
     }
-
-    return buffer;
 }
 
 DNSResourceRecord DNSResourceRecord::deserialize(DNSDeserializationBuffer& buffer) {
@@ -62,9 +62,11 @@ std::string DNSResourceRecord::RecordDataTypes::A::toString(void) {
 }
 
 DNSSerializationBuffer DNSResourceRecord::RecordDataTypes::A::serialize(void) {
-    DNSSerializationBuffer buffer;
-    buffer.serializeUInt32(ipv4Address);
-    return buffer;
+    return DNSSerializationBuffer::from(*this);
+}
+
+void DNSResourceRecord::RecordDataTypes::A::serialize(DNSWireWriter& writer) {
+    writer.writeUInt32(ipv4Address);
 }
 
 DNSResourceRecord::RecordDataTypes::A DNSResourceRecord::RecordDataTypes::A::deserialize(DNSDeserializationBuffer& buffer) {
@@ -88,9 +90,11 @@ std::string DNSResourceRecord::RecordDataTypes::AAAA::toString(void) {
 }
 
 DNSSerializationBuffer DNSResourceRecord::RecordDataTypes::AAAA::serialize(void) {
-    DNSSerializationBuffer buffer;
-    buffer.serializeUInt128(ipv6Address);
-    return buffer;
+    return DNSSerializationBuffer::from(*this);
+}
+
+void DNSResourceRecord::RecordDataTypes::AAAA::serialize(DNSWireWriter& writer) {
+    writer.writeUInt128(ipv6Address);
 }
 
 DNSResourceRecord::RecordDataTypes::AAAA DNSResourceRecord::RecordDataTypes::AAAA::deserialize(DNSDeserializationBuffer& buffer) {
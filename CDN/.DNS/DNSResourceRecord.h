@@ -10,6 +10,7 @@
 #include "DNSDomainName.h"
 #include "Serialization/DNSSerializationBuffer.h"
 #include "Serialization/DNSDeserializationBuffer.h"
+#include "Serialization/DNSWireWriter.h"
 
 enum class DNSRRType : uint16_t {
 	A = 1,
@@ -68,6 +69,7 @@ struct DNSResourceRecord {
 			A(const std::string& ipv4Address);
 			std::string toString(void);
 			DNSSerializationBuffer serialize(void);
+			void serialize(DNSWireWriter& writer);
 			static A deserialize(DNSDeserializationBuffer& buffer);
 		};
 		struct AAAA { /* IPv6 */
@@ -76,6 +78,7 @@ struct DNSResourceRecord {
 			AAAA(const std::string& ipv6address);
 			std::string toString(void);
 			DNSSerializationBuffer serialize(void);
+			void serialize(DNSWireWriter& writer);
 			static AAAA deserialize(DNSDeserializationBuffer& buffer);
 		};
 	};
@@ -90,6 +93,7 @@ struct DNSResourceRecord {
 	DNSResourceRecordData RDATA;
 
     DNSSerializationBuffer serialize(void);
+    void serialize(DNSWireWriter& writer);
     static DNSResourceRecord deserialize(DNSDeserializationBuffer& buffer);
 };
 
@@ -4,8 +4,20 @@
 #include <arpa/inet.h>
 
 #include "DNSDeserializationBuffer.h"
+#include "DNSWireReader.h"
 
-DNSDeserializationBuffer::DNSDeserializationBuffer(std::span<const std::byte> data) : span(data) { }
+DNSDeserializationBuffer::DNSDeserializationBuffer(std::span<const std::byte> data) : packet(data), span(data) { }
+
+DNSWireReader DNSDeserializationBuffer::reader(void) const {
+    return DNSWireReader(packet, packet.size() - span.size());
+}
+
+void DNSDeserializationBuffer::skip(size_t length) {
+    if (span.size() < length) {
+        throw NotEnoughDataException();
+    }
+    span = span.subspan(length);
+}
 
 uint8_t DNSDeserializationBuffer::deserializeUInt8(void) {
     uint8_t result;
@@ -53,6 +65,9 @@ std::string DNSDeserializationBuffer::deserializeDNSLabel(void) {
         throw NotEnoughDataException();
     }
     std::memcpy(&length, span.data(), sizeof(length));
+    if (length > 63) {
+        throw MalformedNameException();
+    }
     span = span.subspan(sizeof(length));
     std::string result;
     if (span.size() < length) {
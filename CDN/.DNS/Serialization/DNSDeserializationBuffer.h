@@ -7,16 +7,25 @@
 #include <vector>
 
 class NotEnoughDataException : public std::exception { };
+// a label type other than a literal or a pointer, a pointer loop, or a name over 255 bytes
+class MalformedNameException : public std::exception { };
+
+class DNSWireReader;
 
 class DNSDeserializationBuffer {
 private:
+    std::span<const std::byte> packet; // all of it, compression pointers count from its start
     std::span<const std::byte> span;
 public:
     DNSDeserializationBuffer(std::span<const std::byte> data);
+    // a reader at the current position, skip() moves past what it read
+    DNSWireReader reader(void) const;
+    void skip(size_t length);
     uint8_t deserializeUInt8(void);
     uint16_t deserializeUInt16(void);
     uint32_t deserializeUInt32(void);
     __uint128_t deserializeUInt128(void);
+    // a literal label, MalformedNameException on a compression pointer
     std::string deserializeDNSLabel(void);
 };
 
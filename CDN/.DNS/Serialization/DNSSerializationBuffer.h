@@ -5,6 +5,10 @@
 #include <cstdint>
 #include <string>
 
+#include "DNSWireWriter.h"
+
+// Growable buffer behind the serialize(void) interface. The parts of a message now write themselves
+// through DNSWireWriter, from() runs that writer over a stack buffer and copies out the result.
 class DNSSerializationBuffer {
 private:
     std::vector<std::byte> m_Data;
@@ -16,6 +20,17 @@ public:
     void serializeDNSLabel(std::string string);
     void concat(const DNSSerializationBuffer& buffer);
     std::vector<std::byte> data(void);
+
+    // a header, name, question or record: none of them is longer than a 512 byte message
+    template <typename Part>
+    static DNSSerializationBuffer from(Part& part) {
+        std::byte bytes[512];
+        DNSWireWriter writer(bytes);
+        part.serialize(writer);
+        DNSSerializationBuffer buffer;
+        buffer.m_Data.assign(writer.written().begin(), writer.written().end());
+        return buffer;
+    }
 };
 
 #endif /* CC7061B7_0353_4BB8_B075_027284DEF298 */
@@ -0,0 +1,41 @@
+#include <cstring>
+#include <arpa/inet.h>
+
+#include "DNSWireReader.h"
+
+DNSWireReader::DNSWireReader(std::span<const std::byte> data, size_t offset) : packet(data), position(offset) { }
+
+const std::byte* DNSWireReader::take(size_t length) {
+    if (position > packet.size() || packet.size() - position < length) {
+        throw NotEnoughDataException();
+    }
+    const std::byte* start = packet.data() + position;
+    position += length;
+    return start;
+}
+
+uint8_t DNSWireReader::readUInt8(void) {
+    return static_cast<uint8_t>(*take(sizeof(uint8_t)));
+}
+
+uint16_t DNSWireReader::readUInt16(void) {
+    uint16_t result;
+    std::memcpy(&result, take(sizeof(result)), sizeof(result));
+    return ntohs(result);
+}
+
+uint32_t DNSWireReader::readUInt32(void) {
+    uint32_t result;
+    std::memcpy(&result, take(sizeof(result)), sizeof(result));
+    return ntohl(result);
+}
+
+__uint128_t DNSWireReader::readUInt128(void) {
+    __uint128_t result;
+    std::memcpy(&result, take(sizeof(result)), sizeof(result));
+    return result;
+}
+
+std::span<const std::byte> DNSWireReader::readBytes(size_t length) {
+    return std::span<const std::byte>(take(length), length);
+}
@@ -0,0 +1,31 @@
+#ifndef DF22F5B8_CF51_4F7B_AE19_ABA1CFFDB3DA
+#define DF22F5B8_CF51_4F7B_AE19_ABA1CFFDB3DA
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "DNSDeserializationBuffer.h"
+
+// Reads wire format values out of a received packet without copying it. Unlike
+// DNSDeserializationBuffer it keeps the whole packet and the offset into it, so views of domain
+// names can point back into the packet. Running out of data throws NotEnoughDataException.
+class DNSWireReader {
+private:
+    std::span<const std::byte> packet;
+    size_t position;
+
+    const std::byte* take(size_t length);
+public:
+    DNSWireReader(std::span<const std::byte> data, size_t offset = 0);
+    uint8_t readUInt8(void);
+    uint16_t readUInt16(void);
+    uint32_t readUInt32(void);
+    __uint128_t readUInt128(void);
+    std::span<const std::byte> readBytes(size_t length);
+
+    size_t offset(void) const { return position; }
+    std::span<const std::byte> data(void) const { return packet; }
+};
+
+#endif /* DF22F5B8_CF51_4F7B_AE19_ABA1CFFDB3DA */
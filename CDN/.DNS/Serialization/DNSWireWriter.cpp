@@ -0,0 +1,95 @@
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+
+#include "DNSWireWriter.h"
+
+DNSWireWriter::DNSWireWriter(std::span<std::byte> out) : span(out) { }
+
+std::byte* DNSWireWriter::reserve(size_t length) {
+    if (span.size() - position < length) {
+        throw NotEnoughSpaceException();
+    }
+    std::byte* start = span.data() + position;
+    position += length;
+    return start;
+}
+
+void DNSWireWriter::writeUInt8(uint8_t num) {
+    *reserve(sizeof(num)) = static_cast<std::byte>(num);
+}
+
+void DNSWireWriter::writeUInt16(uint16_t num) {
+    num = htons(num);
+    std::memcpy(reserve(sizeof(num)), &num, sizeof(num));
+}
+
+void DNSWireWriter::writeUInt32(uint32_t num) {
+    num = htonl(num);
+    std::memcpy(reserve(sizeof(num)), &num, sizeof(num));
+}
+
+// like DNSSerializationBuffer, 128 bit values are already kept in network order
+void DNSWireWriter::writeUInt128(__uint128_t num) {
+    std::memcpy(reserve(sizeof(num)), &num, sizeof(num));
+}
+
+void DNSWireWriter::writeDNSLabel(std::string_view label) {
+    if (label.length() > 63) {
+        throw std::invalid_argument("DNS label longer than 63 bytes");
+    }
+    std::byte* out = reserve(1 + label.length());
+    out[0] = static_cast<std::byte>(label.length());
+    std::memcpy(out + 1, label.data(), label.length());
+}
+
+// whether the name written at offset is exactly labels, looked up in what is already written
+bool DNSWireWriter::nameAt(size_t offset, std::span<const std::string> labels) const {
+    size_t i = 0;
+    while (offset < position) {
+        uint8_t length = static_cast<uint8_t>(span[offset]);
+        // our own pointers always go back to a complete name
+        if ((length & 0xC0) == 0xC0) {
+            offset = ((length & 0x3F) << 8) | static_cast<uint8_t>(span[offset + 1]);
+            continue;
+        }
+        if (i == labels.size()) {
+            return length == 0;
+        }
+        if (length != labels[i].length() || offset + 1 + length > position ||
+            std::memcmp(span.data() + offset + 1, labels[i].data(), length) != 0) {
+            return false;
+        }
+        offset += 1 + length;
+        i++;
+    }
+    return false;
+}
+
+void DNSWireWriter::writeDNSName(std::span<const std::string> labels) {
+    size_t count = 0;
+    while (count < labels.size() && !labels[count].empty()) {
+        count++;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        std::span<const std::string> suffix = labels.subspan(i, count - i);
+        for (int j = 0; j < numNameOffsets; j++) {
+            if (nameAt(nameOffsets[j], suffix)) {
+                writeUInt16(0xC000 | nameOffsets[j]);
+                return;
+            }
+        }
+        // pointers have 14 bits, later names can only refer to the start of the message
+        size_t start = position;
+        writeDNSLabel(labels[i]);
+        if (start <= 0x3FFF && numNameOffsets < MAX_NAME_OFFSETS) {
+            nameOffsets[numNameOffsets++] = start;
+        }
+    }
+    writeUInt8(0);
+}
+
+void DNSWireWriter::writeBytes(std::span<const std::byte> bytes) {
+    std::memcpy(reserve(bytes.size()), bytes.data(), bytes.size());
+}
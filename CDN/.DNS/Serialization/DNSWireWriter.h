@@ -0,0 +1,45 @@
+#ifndef DF2B4110_05AD_49E5_B81B_BBE94CE8C126
+#define DF2B4110_05AD_49E5_B81B_BBE94CE8C126
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+class NotEnoughSpaceException : public std::exception { };
+
+// Writes a message in wire format straight into memory owned by the caller. Every write is bounds
+// checked against the span and throws NotEnoughSpaceException instead of growing anything.
+//
+// Domain names are compressed (RFC 1035 4.1.4): the longest suffix of a name that was already
+// written into this message is replaced by a pointer to it, so the answers of a response cost two
+// bytes per name instead of repeating the question's.
+class DNSWireWriter {
+private:
+    // where the names written so far start, including each of their suffixes
+    static constexpr int MAX_NAME_OFFSETS = 64;
+
+    std::span<std::byte> span;
+    size_t position = 0;
+    uint16_t nameOffsets[MAX_NAME_OFFSETS];
+    int numNameOffsets = 0;
+
+    std::byte* reserve(size_t length);
+    bool nameAt(size_t offset, std::span<const std::string> labels) const;
+public:
+    DNSWireWriter(std::span<std::byte> out);
+    void writeUInt8(uint8_t num);
+    void writeUInt16(uint16_t num);
+    void writeUInt32(uint32_t num);
+    void writeUInt128(__uint128_t num);
+    void writeDNSLabel(std::string_view label);
+    // labels in order, up to the empty root label
+    void writeDNSName(std::span<const std::string> labels);
+    void writeBytes(std::span<const std::byte> bytes);
+
+    size_t size(void) const { return position; }
+    std::span<const std::byte> written(void) const { return span.first(position); }
+};
+
+#endif /* DF2B4110_05AD_49E5_B81B_BBE94CE8C126 */
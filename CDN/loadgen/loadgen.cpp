@@ -0,0 +1,806 @@
+#include <string>
+#include <iostream>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <vector>
+#include <queue>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include "EventLoop.h"
+#include "HttpParser.h"
+
+using Clock = std::chrono::steady_clock;
+
+class Argument
+{
+public:
+    std::string host = "127.0.0.1";
+    int port = 0;
+    int players = 10;
+    double duration = 30.0;
+    std::vector<std::string> videos = {"charge"};
+    double maxBuffer = 30.0;
+    double bitrateMultiplier = 1.5;
+    double adaptationGain = 0.5;
+    double rampUp = 0.0;
+};
+
+// one quality of a video, from the master playlist
+class Variant
+{
+public:
+    int bandwidth = 0;        // bits per second
+    std::string playlist;     // e.g. charge_240p.m3u8
+    std::vector<std::string> segments;
+    std::vector<double> durations;
+};
+
+// what a player is waiting for
+enum class Phase
+{
+    Master,   // the master playlist
+    Variants, // one variant playlist after the other
+    Segments, // the chunks, in order
+    Idle      // buffer full, until wakeAt
+};
+
+// One simulated HLS player: fetches the master playlist, every variant playlist and then the chunks
+// of one video on a keep-alive connection, one request at a time like hls.js does. The next chunk is
+// requested while the playback buffer is below maxBuffer; the bitrate is the highest one the
+// throughput EWMA covers bitrateMultiplier times. Playback drains the buffer in real time and stalls
+// when it runs empty. At the end of the video the player starts over.
+class Player
+{
+public:
+    int id = 0;
+    std::string video;
+    int socket = -1;
+    bool connected = false;
+    Phase phase = Phase::Master;
+    Clock::time_point wakeAt;
+
+    // the ladder, lowest bitrate first; variants whose playlist failed are dropped
+    std::vector<Variant> ladder;
+    size_t variantIndex = 0;
+    bool ready = false; // every playlist is in, chunks can be fetched
+    size_t segment = 0;
+    size_t rung = 0;        // of the chunk being fetched
+    size_t playedRung = 0;  // of the last chunk that arrived
+    bool firstChunk = true;
+    bool retryLowest = false; // the chunk was missing at the chosen bitrate, ask for the lowest
+
+    // request in progress
+    std::string outgoing;
+    size_t outgoingSent = 0;
+    Clock::time_point requestStart;
+    Clock::time_point firstByte;
+    std::string header;
+    bool gotHeader = false;
+    HttpResponseHead head;
+    BodyFramer body;
+    std::string payload; // playlists only, chunk bodies are counted and dropped
+    size_t bodyBytes = 0;
+
+    // playback
+    Clock::time_point sessionStart;
+    Clock::time_point lastUpdate;
+    bool playing = false;
+    bool stalled = false;
+    bool downloaded = false; // the last chunk is in, an empty buffer ends the session
+    double bufferSeconds = 0.0;
+    double throughputKbps = 0.0;
+};
+
+// results of every player
+class Stats
+{
+public:
+    std::vector<double> chunkLatencies; // seconds, request to last byte
+    std::vector<double> firstByteLatencies;
+    std::vector<double> startupDelays;
+    size_t chunks = 0;
+    size_t errors = 0;        // connections that failed or broke
+    size_t missing = 0;       // responses other than 200
+    size_t bytes = 0;
+    size_t sessions = 0;
+    size_t switches = 0;
+    double bitrateSum = 0.0; // kbps, over chunks
+    double playSeconds = 0.0;
+    double stallSeconds = 0.0;
+};
+
+Stats stats;
+Argument args;
+std::vector<Player> players;
+// player owning each socket, -1 for none
+std::vector<int> socketOwner;
+// players waiting for a timer, earliest first; stale entries are skipped
+std::priority_queue<std::pair<Clock::time_point, int>, std::vector<std::pair<Clock::time_point, int>>,
+                    std::greater<std::pair<Clock::time_point, int>>>
+    timers;
+
+const int STATUS_ERROR = -1;
+const int MAX_BUFFER_SIZE = 64 * 1024;
+
+double secondsBetween(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double>(to - from).count();
+}
+
+// Function to parse the command line arguments
+void parsingArgument(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--host") == 0)
+            args.host = argv[++i];
+        else if (strcmp(argv[i], "--port") == 0)
+            args.port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--players") == 0)
+            args.players = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--duration") == 0)
+            args.duration = atof(argv[++i]);
+        else if (strcmp(argv[i], "--videos") == 0)
+        {
+            args.videos.clear();
+            std::stringstream list(argv[++i]);
+            std::string video;
+            while (std::getline(list, video, ','))
+                args.videos.push_back(video);
+        }
+        else if (strcmp(argv[i], "--max-buffer") == 0)
+            args.maxBuffer = atof(argv[++i]);
+        else if (strcmp(argv[i], "--bitrate-multiplier") == 0)
+            args.bitrateMultiplier = atof(argv[++i]);
+        else if (strcmp(argv[i], "--adaptation-gain") == 0)
+            args.adaptationGain = atof(argv[++i]);
+        else if (strcmp(argv[i], "--ramp-up") == 0)
+            args.rampUp = atof(argv[++i]);
+        else
+        {
+            std::cerr << "Unknown argument " << argv[i] << std::endl;
+            exit(1);
+        }
+    }
+    if (args.port <= 0 || args.players <= 0 || args.videos.empty())
+    {
+        std::cerr << "usage: loadgen --port PORT [--host IP] [--players N] [--duration S] [--videos a,b] "
+                     "[--max-buffer S] [--bitrate-multiplier M] [--adaptation-gain A] [--ramp-up S]"
+                  << std::endl;
+        exit(1);
+    }
+}
+
+void schedule(Player &player, Clock::time_point when)
+{
+    player.wakeAt = when;
+    timers.push({when, player.id});
+}
+
+// drain the playback buffer up to now, counting stalls
+void advancePlayback(Player &player, Clock::time_point now)
+{
+    double elapsed = secondsBetween(player.lastUpdate, now);
+    player.lastUpdate = now;
+    if (!player.playing)
+    {
+        return;
+    }
+    if (player.stalled)
+    {
+        stats.stallSeconds += elapsed;
+        return;
+    }
+    if (player.bufferSeconds >= elapsed)
+    {
+        player.bufferSeconds -= elapsed;
+        stats.playSeconds += elapsed;
+        return;
+    }
+    stats.playSeconds += player.bufferSeconds;
+    double stall = elapsed - player.bufferSeconds;
+    player.bufferSeconds = 0.0;
+    if (player.downloaded)
+    {
+        // the video is over, not stalled
+        player.playing = false;
+        return;
+    }
+    stats.stallSeconds += stall;
+    player.stalled = true;
+}
+
+void closePlayerSocket(EventLoop &loop, Player &player)
+{
+    if (player.socket != STATUS_ERROR)
+    {
+        loop.remove(player.socket);
+        close(player.socket);
+        socketOwner[player.socket] = STATUS_ERROR;
+        player.socket = STATUS_ERROR;
+        player.connected = false;
+    }
+}
+
+// non-blocking connect, the request goes out once the socket turns writable
+bool connectPlayer(EventLoop &loop, Player &player)
+{
+    int s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s < 0)
+    {
+        perror("socket");
+        return false;
+    }
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(args.port);
+    inet_pton(AF_INET, args.host.c_str(), &addr.sin_addr);
+    if (connect(s, (sockaddr *)&addr, sizeof(addr)) == STATUS_ERROR && errno != EINPROGRESS)
+    {
+        perror("connect");
+        close(s);
+        return false;
+    }
+
+    if ((size_t)s >= socketOwner.size())
+    {
+        socketOwner.resize(s + 1, STATUS_ERROR);
+    }
+    socketOwner[s] = player.id;
+    player.socket = s;
+    player.connected = false;
+    loop.add(s, EventLoop::BASE_EVENTS | EPOLLOUT);
+    return true;
+}
+
+// write as much of the pending request as the socket takes
+bool sendPending(EventLoop &loop, Player &player)
+{
+    while (player.outgoingSent < player.outgoing.size())
+    {
+        ssize_t n = send(player.socket, player.outgoing.data() + player.outgoingSent,
+                         player.outgoing.size() - player.outgoingSent, MSG_NOSIGNAL);
+        if (n == STATUS_ERROR)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                loop.setWriteInterest(player.socket, true);
+                return true;
+            }
+            return false;
+        }
+        player.outgoingSent += n;
+    }
+    loop.setWriteInterest(player.socket, false);
+    return true;
+}
+
+void sendRequest(EventLoop &loop, Player &player, const std::string &path)
+{
+    player.outgoing = "GET " + path + " HTTP/1.1\r\nHost: " + args.host + ":" + std::to_string(args.port) + "\r\n\r\n";
+    player.outgoingSent = 0;
+    player.header.clear();
+    player.gotHeader = false;
+    player.payload.clear();
+    player.bodyBytes = 0;
+    player.requestStart = Clock::now();
+
+    if (player.socket == STATUS_ERROR && !connectPlayer(loop, player))
+    {
+        stats.errors++;
+        schedule(player, Clock::now() + std::chrono::seconds(1));
+        player.phase = Phase::Idle;
+        return;
+    }
+    if (player.connected && !sendPending(loop, player))
+    {
+        closePlayerSocket(loop, player);
+        stats.errors++;
+        schedule(player, Clock::now() + std::chrono::seconds(1));
+        player.phase = Phase::Idle;
+    }
+}
+
+// name of a chunk at another bitrate, e.g. (charge_240p.m3u8 ladder entry, charge_240p_0003.ts)
+std::string chunkAt(const Player &player, size_t rung)
+{
+    return player.ladder[rung].segments[player.segment];
+}
+
+// the highest bitrate the throughput estimate covers
+size_t pickRung(const Player &player)
+{
+    size_t rung = 0;
+    for (size_t i = 0; i < player.ladder.size(); i++)
+    {
+        if (player.ladder[i].bandwidth / 1000.0 * args.bitrateMultiplier <= player.throughputKbps)
+        {
+            rung = i;
+        }
+    }
+    return rung;
+}
+
+void startSession(EventLoop &loop, Player &player)
+{
+    Clock::time_point now = Clock::now();
+    player.phase = Phase::Master;
+    player.ladder.clear();
+    player.ready = false;
+    player.segment = 0;
+    player.firstChunk = true;
+    player.retryLowest = false;
+    player.sessionStart = now;
+    player.lastUpdate = now;
+    player.playing = false;
+    player.stalled = false;
+    player.downloaded = false;
+    player.bufferSeconds = 0.0;
+    sendRequest(loop, player, "/" + player.video + "/" + player.video + ".m3u8");
+}
+
+// request the next chunk, or wait while the buffer is full
+void nextChunk(EventLoop &loop, Player &player)
+{
+    Clock::time_point now = Clock::now();
+    advancePlayback(player, now);
+
+    if (player.downloaded)
+    {
+        // the session ends when the buffer played out
+        if (player.playing)
+        {
+            player.phase = Phase::Idle;
+            schedule(player, now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(player.bufferSeconds)));
+            return;
+        }
+        // nothing of it could be played, do not hammer the server with new sessions
+        if (player.firstChunk)
+        {
+            player.ready = false;
+            player.phase = Phase::Idle;
+            schedule(player, now + std::chrono::seconds(1));
+            return;
+        }
+        startSession(loop, player);
+        return;
+    }
+    if (player.bufferSeconds > args.maxBuffer)
+    {
+        player.phase = Phase::Idle;
+        schedule(player, now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(player.bufferSeconds - args.maxBuffer)));
+        return;
+    }
+
+    // qualities may have a few segments less than the lowest one
+    size_t rung = player.retryLowest ? 0 : pickRung(player);
+    while (rung > 0 && player.segment >= player.ladder[rung].segments.size())
+    {
+        rung--;
+    }
+    player.rung = rung;
+    player.phase = Phase::Segments;
+    sendRequest(loop, player, "/" + player.video + "/" + chunkAt(player, rung));
+}
+
+void parseMaster(Player &player)
+{
+    std::istringstream lines(player.payload);
+    std::string line;
+    int bandwidth = 0;
+    while (std::getline(lines, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        size_t pos = line.find("BANDWIDTH=");
+        if (line.starts_with("#EXT-X-STREAM-INF") && pos != std::string::npos)
+        {
+            bandwidth = atoi(line.c_str() + pos + 10);
+        }
+        else if (!line.empty() && line[0] != '#' && bandwidth > 0)
+        {
+            Variant variant;
+            variant.bandwidth = bandwidth;
+            variant.playlist = line;
+            player.ladder.push_back(variant);
+            bandwidth = 0;
+        }
+    }
+    std::sort(player.ladder.begin(), player.ladder.end(),
+              [](const Variant &a, const Variant &b) { return a.bandwidth < b.bandwidth; });
+}
+
+void parseVariant(Variant &variant, const std::string &playlist)
+{
+    std::istringstream lines(playlist);
+    std::string line;
+    double duration = 0.0;
+    while (std::getline(lines, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.starts_with("#EXTINF:"))
+        {
+            duration = atof(line.c_str() + 8);
+        }
+        else if (!line.empty() && line[0] != '#')
+        {
+            variant.segments.push_back(line);
+            variant.durations.push_back(duration);
+        }
+    }
+}
+
+// a whole response arrived, move the player on
+void responseDone(EventLoop &loop, Player &player)
+{
+    Clock::time_point now = Clock::now();
+    bool ok = player.head.status == 200;
+
+    if (player.phase == Phase::Master)
+    {
+        if (ok)
+        {
+            parseMaster(player);
+        }
+        if (player.ladder.empty())
+        {
+            stats.errors++;
+            player.phase = Phase::Idle;
+            schedule(player, now + std::chrono::seconds(1));
+            return;
+        }
+        player.phase = Phase::Variants;
+        player.variantIndex = 0;
+        sendRequest(loop, player, "/" + player.video + "/" + player.ladder[0].playlist);
+        return;
+    }
+
+    if (player.phase == Phase::Variants)
+    {
+        if (ok)
+        {
+            parseVariant(player.ladder[player.variantIndex], player.payload);
+        }
+        // a quality without a playlist cannot be played
+        if (player.ladder[player.variantIndex].segments.empty())
+        {
+            player.ladder.erase(player.ladder.begin() + player.variantIndex);
+        }
+        else
+        {
+            player.variantIndex++;
+        }
+        if (player.variantIndex < player.ladder.size())
+        {
+            sendRequest(loop, player, "/" + player.video + "/" + player.ladder[player.variantIndex].playlist);
+            return;
+        }
+        if (player.ladder.empty())
+        {
+            stats.errors++;
+            player.phase = Phase::Idle;
+            schedule(player, now + std::chrono::seconds(1));
+            return;
+        }
+        player.ready = true;
+        nextChunk(loop, player);
+        return;
+    }
+
+    // a chunk
+    if (!ok)
+    {
+        stats.missing++;
+        if (player.retryLowest || player.rung == 0)
+        {
+            // not even the lowest bitrate exists, skip it
+            player.retryLowest = false;
+            player.segment++;
+            player.downloaded = player.segment >= player.ladder[0].segments.size();
+        }
+        else
+        {
+            player.retryLowest = true;
+        }
+        nextChunk(loop, player);
+        return;
+    }
+
+    double seconds = std::max(secondsBetween(player.requestStart, now), 1e-6);
+    double kbps = player.bodyBytes * 8.0 / seconds / 1000.0;
+    player.throughputKbps = player.throughputKbps == 0.0 ? kbps : args.adaptationGain * kbps + (1 - args.adaptationGain) * player.throughputKbps;
+    stats.chunks++;
+    stats.bytes += player.bodyBytes;
+    stats.chunkLatencies.push_back(seconds);
+    stats.firstByteLatencies.push_back(secondsBetween(player.requestStart, player.firstByte));
+    stats.bitrateSum += player.ladder[player.rung].bandwidth / 1000.0;
+
+    advancePlayback(player, now);
+    player.bufferSeconds += player.ladder[player.rung].durations[player.segment];
+    if (!player.firstChunk && player.rung != player.playedRung)
+    {
+        stats.switches++;
+    }
+    player.playedRung = player.rung;
+    if (player.firstChunk)
+    {
+        stats.sessions++;
+        stats.startupDelays.push_back(secondsBetween(player.sessionStart, now));
+        player.firstChunk = false;
+        player.playing = true;
+    }
+    player.stalled = false;
+    player.retryLowest = false;
+    player.segment++;
+    player.downloaded = player.segment >= player.ladder[0].segments.size();
+    nextChunk(loop, player);
+}
+
+// read what arrived for a player, false once its socket is drained or closed
+bool receive(EventLoop &loop, Player &player)
+{
+    char buffer[MAX_BUFFER_SIZE];
+    ssize_t n = recv(player.socket, buffer, sizeof(buffer), 0);
+    if (n == STATUS_ERROR)
+    {
+        if (errno == EINTR)
+            return true;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return false;
+    }
+    if (n <= 0)
+    {
+        // a body running until the close is complete now, anything else was cut short
+        bool complete = player.gotHeader && player.body.mode() == BodyFramer::Mode::UntilClose;
+        closePlayerSocket(loop, player);
+        if (complete)
+        {
+            responseDone(loop, player);
+        }
+        else if (player.phase != Phase::Idle)
+        {
+            stats.errors++;
+            player.phase = Phase::Idle;
+            schedule(player, Clock::now() + std::chrono::seconds(1));
+        }
+        return false;
+    }
+
+    size_t offset = 0;
+    while (offset < (size_t)n)
+    {
+        if (!player.gotHeader)
+        {
+            if (player.header.empty())
+            {
+                player.firstByte = Clock::now();
+            }
+            size_t previous = player.header.size();
+            size_t searchFrom = previous > 3 ? previous - 3 : 0;
+            player.header.append(buffer + offset, n - offset);
+            size_t headerEnd = findHeaderEnd(player.header, searchFrom);
+            if (headerEnd == 0)
+            {
+                return true;
+            }
+            if (parseResponseHead(std::string_view(player.header.data(), headerEnd), false, player.head) != ParseResult::Complete)
+            {
+                closePlayerSocket(loop, player);
+                stats.errors++;
+                player.phase = Phase::Idle;
+                schedule(player, Clock::now() + std::chrono::seconds(1));
+                return false;
+            }
+            offset += headerEnd - previous;
+            player.header.resize(headerEnd);
+            player.gotHeader = true;
+            player.body.start(player.head.bodyMode, player.head.contentLength);
+        }
+
+        bool keepPayload = player.phase == Phase::Master || player.phase == Phase::Variants;
+        size_t before = player.payload.size();
+        size_t used = player.body.consume(buffer + offset, n - offset, keepPayload ? &player.payload : nullptr);
+        player.bodyBytes += keepPayload ? player.payload.size() - before : used;
+        offset += used;
+        if (player.body.failed())
+        {
+            closePlayerSocket(loop, player);
+            stats.errors++;
+            player.phase = Phase::Idle;
+            schedule(player, Clock::now() + std::chrono::seconds(1));
+            return false;
+        }
+        if (!player.body.done())
+        {
+            continue;
+        }
+
+        int socket = player.socket;
+        if (!player.head.keepAlive)
+        {
+            closePlayerSocket(loop, player);
+        }
+        responseDone(loop, player);
+        // one request at a time, nothing else can be in this read; the next response comes on the
+        // same connection unless it was closed
+        return player.socket == socket;
+    }
+    return true;
+}
+
+void handleEvent(EventLoop &loop, const epoll_event &event)
+{
+    int s = event.data.fd;
+    if (s < 0 || (size_t)s >= socketOwner.size() || socketOwner[s] == STATUS_ERROR)
+    {
+        return;
+    }
+    Player &player = players[socketOwner[s]];
+
+    if ((event.events & EPOLLOUT) && player.socket == s)
+    {
+        if (!player.connected)
+        {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            getsockopt(s, SOL_SOCKET, SO_ERROR, &error, &len);
+            if (error != 0)
+            {
+                closePlayerSocket(loop, player);
+                stats.errors++;
+                player.phase = Phase::Idle;
+                schedule(player, Clock::now() + std::chrono::seconds(1));
+                return;
+            }
+            player.connected = true;
+        }
+        if (!sendPending(loop, player))
+        {
+            closePlayerSocket(loop, player);
+            stats.errors++;
+            player.phase = Phase::Idle;
+            schedule(player, Clock::now() + std::chrono::seconds(1));
+            return;
+        }
+    }
+
+    if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+    {
+        while (player.socket == s && receive(loop, player))
+        {
+        }
+    }
+}
+
+// a player's timer went off: start it, retry it, or fetch once its buffer drained
+void wake(EventLoop &loop, Player &player)
+{
+    if (player.phase != Phase::Idle)
+    {
+        return;
+    }
+    if (!player.ready)
+    {
+        startSession(loop, player);
+        return;
+    }
+    nextChunk(loop, player);
+}
+
+double percentile(std::vector<double> &values, double p)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    // nearest rank
+    size_t rank = (size_t)std::ceil(p * values.size());
+    size_t index = rank == 0 ? 0 : std::min(rank, values.size()) - 1;
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void printLatencies(const char *name, std::vector<double> &values)
+{
+    printf("%-16s p50 %8.2f  p90 %8.2f  p99 %8.2f  max %8.2f\n", name, percentile(values, 0.5) * 1000,
+           percentile(values, 0.9) * 1000, percentile(values, 0.99) * 1000, percentile(values, 1.0) * 1000);
+}
+
+void report(double elapsed)
+{
+    printf("players %d  duration %.1f s  sessions %zu\n", args.players, elapsed, stats.sessions);
+    printf("chunks %zu  missing %zu  errors %zu  bytes %zu  throughput %.1f Mbit/s\n", stats.chunks, stats.missing,
+           stats.errors, stats.bytes, stats.bytes * 8.0 / elapsed / 1e6);
+    printLatencies("chunk ms", stats.chunkLatencies);
+    printLatencies("first byte ms", stats.firstByteLatencies);
+    printLatencies("startup ms", stats.startupDelays);
+    double playerMinutes = args.players * elapsed / 60.0;
+    printf("avg bitrate %.0f kbps  switches %zu (%.2f per player-minute)\n",
+           stats.chunks == 0 ? 0.0 : stats.bitrateSum / stats.chunks, stats.switches, stats.switches / playerMinutes);
+    double watched = stats.playSeconds + stats.stallSeconds;
+    printf("rebuffer ratio %.4f  (stalled %.1f s of %.1f s)\n", watched == 0.0 ? 0.0 : stats.stallSeconds / watched,
+           stats.stallSeconds, watched);
+}
+
+// every player needs a descriptor, so lift the soft limit as far as allowed
+void raiseFileLimit()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    parsingArgument(argc, argv);
+    raiseFileLimit();
+
+    EventLoop loop;
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(args.duration));
+
+    // players join evenly over the ramp-up
+    players.resize(args.players);
+    for (int i = 0; i < args.players; i++)
+    {
+        Player &player = players[i];
+        player.id = i;
+        player.video = args.videos[i % args.videos.size()];
+        player.phase = Phase::Idle;
+        schedule(player, start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(args.rampUp * i / args.players)));
+    }
+
+    while (true)
+    {
+        Clock::time_point now = Clock::now();
+        if (now >= end)
+        {
+            break;
+        }
+        while (!timers.empty() && timers.top().first <= now)
+        {
+            auto [when, id] = timers.top();
+            timers.pop();
+            // a later schedule() replaced this entry
+            if (players[id].wakeAt == when)
+            {
+                wake(loop, players[id]);
+            }
+        }
+
+        Clock::time_point until = timers.empty() ? end : std::min(end, timers.top().first);
+        int timeoutMs = (int)std::ceil(std::max(secondsBetween(Clock::now(), until), 0.0) * 1000);
+        for (epoll_event &event : loop.wait(timeoutMs))
+        {
+            handleEvent(loop, event);
+        }
+    }
+
+    // stalls up to the end count too
+    Clock::time_point now = Clock::now();
+    for (Player &player : players)
+    {
+        advancePlayback(player, now);
+    }
+    report(secondsBetween(start, now));
+    return 0;
+}
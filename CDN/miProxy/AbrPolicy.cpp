@@ -0,0 +1,144 @@
+#include <algorithm>
+
+#include "AbrPolicy.h"
+
+std::unique_ptr<AbrPolicy> AbrPolicy::create(const std::string &name, double multiplier)
+{
+    if (name == "throughput")
+    {
+        return std::make_unique<ThroughputPolicy>(multiplier);
+    }
+    if (name == "buffer")
+    {
+        return std::make_unique<BufferPolicy>();
+    }
+    if (name == "mpc")
+    {
+        return std::make_unique<MpcPolicy>();
+    }
+    return nullptr;
+}
+
+size_t ThroughputPolicy::peek(const AbrSession &session, size_t segment) const
+{
+    (void)segment;
+    return session.ladder->select(session.avgThroughput, multiplier);
+}
+
+size_t BufferPolicy::peek(const AbrSession &session, size_t segment) const
+{
+    (void)segment;
+    const BitrateLadder &ladder = *session.ladder;
+    size_t highest = ladder.bandwidths.size() - 1;
+    double buffer = session.bufferAt(std::chrono::steady_clock::now());
+
+    // rate map: lowest bitrate up to the reservoir, highest past the cushion, linear in between
+    double rate;
+    if (buffer <= RESERVOIR_SECONDS)
+    {
+        rate = ladder.bandwidths.front();
+    }
+    else if (buffer >= RESERVOIR_SECONDS + CUSHION_SECONDS)
+    {
+        rate = ladder.bandwidths.back();
+    }
+    else
+    {
+        rate = ladder.bandwidths.front() +
+               (buffer - RESERVOIR_SECONDS) / CUSHION_SECONDS * (ladder.bandwidths.back() - ladder.bandwidths.front());
+    }
+
+    // only move off the previous bitrate once the map crosses a neighbouring rung, so the
+    // bitrate does not flap while the buffer hovers around a boundary
+    size_t previous = std::min(session.lastRung, highest);
+    int rateUp = ladder.bandwidths[std::min(previous + 1, highest)];
+    int rateDown = ladder.bandwidths[previous == 0 ? 0 : previous - 1];
+    size_t rung = previous;
+    if (rate >= rateUp)
+    {
+        rung = ladder.select(rate, 1.0);
+    }
+    else if (rate <= rateDown)
+    {
+        // lowest bitrate still at or above the map
+        rung = std::lower_bound(ladder.bandwidths.begin(), ladder.bandwidths.end(), rate) - ladder.bandwidths.begin();
+        rung = std::min(rung, highest);
+    }
+    return rung;
+}
+
+// best achievable score of the remaining segments in the horizon, writing the first choice to firstRung
+static double planAhead(const AbrSession &session, size_t segment, size_t depth, size_t previousRung,
+                        double buffer, double throughput, size_t *firstRung)
+{
+    if (depth == MpcPolicy::HORIZON)
+    {
+        return 0.0;
+    }
+
+    const BitrateLadder &ladder = *session.ladder;
+    // a second of stalling costs as much as a second at the highest bitrate gains
+    double rebufferPenalty = ladder.bandwidths.back() / 1000.0;
+    double best = -1e18;
+
+    for (size_t rung = 0; rung < ladder.bandwidths.size(); rung++)
+    {
+        double seconds = session.segmentDuration(segment + depth);
+        double downloadTime = ladder.bandwidths[rung] * seconds / throughput;
+        double rebuffer = std::max(0.0, downloadTime - buffer);
+        double nextBuffer = std::max(0.0, buffer - downloadTime) + seconds;
+
+        double quality = ladder.bandwidths[rung] / 1000.0;
+        double change = std::abs(ladder.bandwidths[rung] - ladder.bandwidths[previousRung]) / 1000.0;
+        double score = quality * seconds - rebufferPenalty * rebuffer - MpcPolicy::SWITCH_PENALTY * change +
+                       planAhead(session, segment, depth + 1, rung, nextBuffer, throughput, nullptr);
+        if (score > best)
+        {
+            best = score;
+            if (firstRung != nullptr)
+            {
+                *firstRung = rung;
+            }
+        }
+    }
+    return best;
+}
+
+double MpcPolicy::predict(const AbrSession &session)
+{
+    // the harmonic mean is not dragged up by a single fast download
+    if (session.recentThroughputs.empty())
+    {
+        return session.avgThroughput;
+    }
+    double inverseSum = 0.0;
+    for (double thru : session.recentThroughputs)
+    {
+        inverseSum += 1.0 / thru;
+    }
+    return session.recentThroughputs.size() / inverseSum;
+}
+
+size_t MpcPolicy::select(AbrSession &session, size_t segment) const
+{
+    session.lastPrediction = predict(session);
+    return peek(session, segment);
+}
+
+size_t MpcPolicy::peek(const AbrSession &session, size_t segment) const
+{
+    double prediction = predict(session);
+
+    // RobustMPC: lower the prediction by the worst error seen recently
+    double maxError = 0.0;
+    for (double error : session.predictionErrors)
+    {
+        maxError = std::max(maxError, error);
+    }
+    double throughput = prediction / (1.0 + maxError);
+
+    size_t previous = std::min(session.lastRung, session.ladder->bandwidths.size() - 1);
+    size_t rung = 0;
+    planAhead(session, segment, 0, previous, session.bufferAt(std::chrono::steady_clock::now()), throughput, &rung);
+    return rung;
+}
@@ -0,0 +1,69 @@
+#ifndef A93F6E21_5C8B_4D07_A1E4_6B2D90C7F358
+#define A93F6E21_5C8B_4D07_A1E4_6B2D90C7F358
+
+#include <memory>
+#include <string>
+
+#include "AbrSession.h"
+
+// Decides the bitrate of a viewer's next chunk. Policies keep no state of their own, everything
+// they learn lives in the AbrSession, so one instance serves every viewer on every worker.
+// select() and peek() are called with the session's mutex held and the session's ladder set.
+class AbrPolicy
+{
+public:
+    virtual ~AbrPolicy() = default;
+
+    // ladder index for the given segment of the session's video, leaving the session as it is
+    // (prefetch looks ahead with it)
+    virtual size_t peek(const AbrSession &session, size_t segment) const = 0;
+
+    // as peek() for the chunk about to be fetched; the session keeps what the policy needs to judge
+    // it once downloaded, and the caller records the result as lastRung
+    virtual size_t select(AbrSession &session, size_t segment) const { return peek(session, segment); }
+
+    // "throughput", "buffer" or "mpc"; nullptr for an unknown name
+    static std::unique_ptr<AbrPolicy> create(const std::string &name, double multiplier);
+};
+
+// The assignment's rule: the highest bitrate the EWMA throughput supports with the multiplier as headroom.
+class ThroughputPolicy : public AbrPolicy
+{
+private:
+    double multiplier;
+
+public:
+    explicit ThroughputPolicy(double bitrateMultiplier) : multiplier(bitrateMultiplier) {}
+    size_t peek(const AbrSession &session, size_t segment) const override;
+};
+
+// BBA-0 (Huang et al., SIGCOMM 2014): the bitrate follows the estimated player buffer. Below the
+// reservoir the lowest bitrate is used, above reservoir + cushion the highest, and in between the
+// rate map is linear. The player caps its buffer at 10 s (player.html), which sizes both zones.
+class BufferPolicy : public AbrPolicy
+{
+public:
+    static constexpr double RESERVOIR_SECONDS = 3.0;
+    static constexpr double CUSHION_SECONDS = 6.0;
+
+    size_t peek(const AbrSession &session, size_t segment) const override;
+};
+
+// RobustMPC (Yin et al., SIGCOMM 2015): predict throughput as the harmonic mean of the last
+// chunks discounted by the recent prediction error, then pick the first bitrate of the sequence
+// over the next few segments that maximises bitrate minus rebuffering and switching penalties.
+class MpcPolicy : public AbrPolicy
+{
+public:
+    static const size_t HORIZON = 5;
+    static constexpr double SWITCH_PENALTY = 1.0; // per Mbps of bitrate change
+
+    size_t peek(const AbrSession &session, size_t segment) const override;
+    // also keeps the prediction as lastPrediction, its error feeds the next predictions
+    size_t select(AbrSession &session, size_t segment) const override;
+
+    // harmonic mean of the recent chunks' throughput in kbps
+    static double predict(const AbrSession &session);
+};
+
+#endif /* A93F6E21_5C8B_4D07_A1E4_6B2D90C7F358 */
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cmath>
+
+#include "AbrSession.h"
+
+void AbrSession::restart(std::shared_ptr<const BitrateLadder> newLadder)
+{
+    ladder = std::move(newLadder);
+    avgThroughput = ladder->lowest();
+    lastRung = 0;
+    recentThroughputs.clear();
+    predictionErrors.clear();
+    lastPrediction = 0.0;
+    bufferLevel = 0.0;
+    playing = false;
+}
+
+double AbrSession::segmentDuration(size_t segment) const
+{
+    if (timeline == nullptr || timeline->targetDuration == 0.0)
+    {
+        return DEFAULT_SEGMENT_SECONDS;
+    }
+    return timeline->duration(segment);
+}
+
+double AbrSession::bufferAt(std::chrono::steady_clock::time_point now) const
+{
+    if (playing && now > bufferUpdated)
+    {
+        double played = std::chrono::duration<double>(now - bufferUpdated).count();
+        return std::max(0.0, bufferLevel - played);
+    }
+    return bufferLevel;
+}
+
+void AbrSession::recordChunk(const TransferTiming &timing, double gain)
+{
+    recordThroughput(timing, gain);
+    chunkDelivered(timing.lastByte);
+}
+
+void AbrSession::recordThroughput(const TransferTiming &timing, double gain)
+{
+    lastDuration = timing.seconds();
+    lastThroughput = timing.throughputKbps();
+    avgThroughput = gain * lastThroughput + (1 - gain) * avgThroughput;
+
+    if (lastPrediction > 0.0)
+    {
+        predictionErrors.push_back(std::fabs(lastPrediction - lastThroughput) / lastThroughput);
+        if (predictionErrors.size() > HISTORY_LENGTH)
+        {
+            predictionErrors.pop_front();
+        }
+        lastPrediction = 0.0;
+    }
+    recentThroughputs.push_back(lastThroughput);
+    if (recentThroughputs.size() > HISTORY_LENGTH)
+    {
+        recentThroughputs.pop_front();
+    }
+}
+
+void AbrSession::chunkDelivered(std::chrono::steady_clock::time_point now)
+{
+    // playback starts with the first chunk and keeps draining the buffer from then on
+    bufferLevel = bufferAt(now) + inFlightSeconds;
+    bufferUpdated = now;
+    playing = true;
+
+    inFlightSeconds = 0.0;
+}
+
+std::shared_ptr<AbrSession> AbrSessionTable::get(const std::string &browserIp, const std::string &videoName)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (now - lastSweep >= SWEEP_INTERVAL)
+    {
+        sweep(now);
+    }
+
+    Entry &entry = sessions[browserIp + " " + videoName];
+    if (entry.session == nullptr)
+    {
+        entry.session = std::make_shared<AbrSession>();
+        entry.session->browserIp = browserIp;
+        entry.session->videoName = videoName;
+    }
+    entry.lastUsed = now;
+    return entry.session;
+}
+
+void AbrSessionTable::sweep(std::chrono::steady_clock::time_point now)
+{
+    lastSweep = now;
+    for (auto it = sessions.begin(); it != sessions.end();)
+    {
+        // a session still held elsewhere belongs to a request in flight, it stays
+        if (now - it->second.lastUsed >= IDLE_TIMEOUT && it->second.session.use_count() == 1)
+        {
+            it = sessions.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef C58E1D93_7A24_4F6B_9E0D_B31F62A8C4D7
+#define C58E1D93_7A24_4F6B_9E0D_B31F62A8C4D7
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "ManifestCache.h"
+#include "TransferTiming.h"
+
+// Adaptation state of one viewer, i.e. one browser IP watching one video. A browser may spread
+// its requests over several connections (and so several workers), hence the mutex.
+class AbrSession
+{
+public:
+    // how many past chunks the throughput predictors look back on
+    static const size_t HISTORY_LENGTH = 5;
+    // segment length assumed until a variant playlist of the video went through the proxy
+    static constexpr double DEFAULT_SEGMENT_SECONDS = 4.0;
+
+    std::mutex mutex;
+    std::string browserIp = "";
+    std::string videoName = "";
+    std::shared_ptr<const BitrateLadder> ladder;
+    std::shared_ptr<const SegmentTimeline> timeline; // nullptr until a variant playlist was seen
+    double avgThroughput = 0.0; // EWMA throughput estimate in kbps
+
+    // last chunk downloaded for this viewer
+    std::string chunkPath = ""; // directory part of its URI, e.g. /wing_it/
+    double lastDuration = 0.0;   // seconds, request to last byte
+    double lastThroughput = 0.0; // kbps
+    size_t lastRung = 0; // ladder index picked for the previous chunk
+
+    // throughput of the most recent chunks (kbps) and how far off their prediction was, newest last
+    std::deque<double> recentThroughputs;
+    std::deque<double> predictionErrors;
+    double lastPrediction = 0.0; // throughput a policy predicted for the chunk in flight, 0 if none
+
+    // The proxy cannot see the player, so its buffer is estimated: every downloaded chunk adds its
+    // duration and playback drains it in real time from the first chunk on.
+    double bufferLevel = 0.0; // seconds, as of bufferUpdated
+    std::chrono::steady_clock::time_point bufferUpdated;
+    bool playing = false;
+
+    double inFlightSeconds = 0.0; // playback duration of the chunk being fetched, 0 when idle
+
+    // start the estimate over at the lowest bitrate, as for a new stream
+    void restart(std::shared_ptr<const BitrateLadder> newLadder);
+
+    // duration of a segment of this video in seconds
+    double segmentDuration(size_t segment) const;
+
+    // estimated seconds of video buffered in the player at the given time
+    double bufferAt(std::chrono::steady_clock::time_point now) const;
+
+    // a chunk finished downloading: update the EWMA, the history and the buffer estimate
+    void recordChunk(const TransferTiming &timing, double gain);
+
+    // a chunk of this video was downloaded that the player has not asked for yet (prefetch):
+    // the throughput counts, the buffer is left alone
+    void recordThroughput(const TransferTiming &timing, double gain);
+
+    // the chunk in flight reached the player (downloaded or served from the cache)
+    void chunkDelivered(std::chrono::steady_clock::time_point now);
+};
+
+// all viewers seen recently, shared by every worker; a viewer not asked for in IDLE_TIMEOUT is
+// forgotten (and starts over at the lowest bitrate should it come back)
+class AbrSessionTable
+{
+public:
+    static constexpr std::chrono::minutes IDLE_TIMEOUT{10};
+    // how often get() looks for idle viewers
+    static constexpr std::chrono::seconds SWEEP_INTERVAL{30};
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<AbrSession> session;
+        std::chrono::steady_clock::time_point lastUsed;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> sessions;
+    std::chrono::steady_clock::time_point lastSweep = std::chrono::steady_clock::now();
+
+    // drop the viewers idle for IDLE_TIMEOUT that no request is using right now
+    void sweep(std::chrono::steady_clock::time_point now);
+
+public:
+    std::shared_ptr<AbrSession> get(const std::string &browserIp, const std::string &videoName);
+};
+
+#endif /* C58E1D93_7A24_4F6B_9E0D_B31F62A8C4D7 */
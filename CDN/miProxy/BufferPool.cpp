@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "BufferPool.h"
+
+char *BufferPool::allocate(void)
+{
+    if (freeChunks.empty())
+    {
+        // one allocation for a whole slab, cut into chunks
+        slabs.push_back(std::make_unique<char[]>(CHUNK_SIZE * CHUNKS_PER_SLAB));
+        char *slab = slabs.back().get();
+        for (size_t i = CHUNKS_PER_SLAB; i > 0; i--)
+        {
+            freeChunks.push_back(slab + (i - 1) * CHUNK_SIZE);
+        }
+    }
+    char *chunk = freeChunks.back();
+    freeChunks.pop_back();
+    return chunk;
+}
+
+void BufferPool::release(char *chunk)
+{
+    // most recently used first, it is the one most likely still in cache
+    freeChunks.push_back(chunk);
+}
+
+BufferPool &BufferPool::local(void)
+{
+    // never destroyed: buffers in other thread_local tables may still hand chunks back at thread exit
+    thread_local BufferPool *pool = new BufferPool();
+    return *pool;
+}
+
+ChainBuffer::~ChainBuffer()
+{
+    clear();
+}
+
+ChainBuffer::ChainBuffer(ChainBuffer &&other) noexcept
+    : chunks(std::move(other.chunks)), head(other.head), tail(other.tail), bytes(other.bytes)
+{
+    other.chunks.clear();
+    other.head = other.tail = other.bytes = 0;
+}
+
+ChainBuffer &ChainBuffer::operator=(ChainBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        clear();
+        chunks = std::move(other.chunks);
+        head = other.head;
+        tail = other.tail;
+        bytes = other.bytes;
+        other.chunks.clear();
+        other.head = other.tail = other.bytes = 0;
+    }
+    return *this;
+}
+
+void ChainBuffer::append(const char *data, size_t len)
+{
+    BufferPool &pool = BufferPool::local();
+    bytes += len;
+    while (len > 0)
+    {
+        if (chunks.empty() || tail == BufferPool::CHUNK_SIZE)
+        {
+            chunks.push_back(pool.allocate());
+            tail = 0;
+        }
+        size_t n = std::min(len, BufferPool::CHUNK_SIZE - tail);
+        memcpy(chunks.back() + tail, data, n);
+        tail += n;
+        data += n;
+        len -= n;
+    }
+}
+
+int ChainBuffer::iovecs(iovec *iov, int max) const
+{
+    int count = 0;
+    for (size_t i = 0; i < chunks.size() && count < max; i++)
+    {
+        size_t start = i == 0 ? head : 0;
+        size_t end = i + 1 == chunks.size() ? tail : BufferPool::CHUNK_SIZE;
+        iov[count++] = {chunks[i] + start, end - start};
+    }
+    return count;
+}
+
+void ChainBuffer::consume(size_t len)
+{
+    BufferPool &pool = BufferPool::local();
+    len = std::min(len, bytes);
+    bytes -= len;
+    head += len;
+
+    // hand back every chunk that went out entirely
+    size_t done = 0;
+    while (done < chunks.size())
+    {
+        size_t end = done + 1 == chunks.size() ? tail : BufferPool::CHUNK_SIZE;
+        if (head < end)
+        {
+            break;
+        }
+        head -= end;
+        pool.release(chunks[done]);
+        done++;
+    }
+    chunks.erase(chunks.begin(), chunks.begin() + done);
+    if (chunks.empty())
+    {
+        head = tail = 0;
+    }
+}
+
+void ChainBuffer::clear(void)
+{
+    BufferPool &pool = BufferPool::local();
+    for (char *chunk : chunks)
+    {
+        pool.release(chunk);
+    }
+    chunks.clear();
+    head = tail = bytes = 0;
+}
@@ -0,0 +1,72 @@
+#ifndef A61C9E05_37B2_4D18_8F4A_D2E5B07C1963
+#define A61C9E05_37B2_4D18_8F4A_D2E5B07C1963
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <sys/uio.h>
+
+// Fixed-size chunks carved out of larger slabs, recycled through a free list. Each worker thread
+// has its own pool, so allocating and releasing a chunk is a push or pop without any locking.
+// Slabs are kept once allocated: the pool grows to the most bytes the worker ever had queued and
+// serves every later burst from there.
+class BufferPool
+{
+public:
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+    static constexpr size_t CHUNKS_PER_SLAB = 64;
+
+private:
+    std::vector<std::unique_ptr<char[]>> slabs;
+    std::vector<char *> freeChunks;
+
+public:
+    BufferPool() = default;
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    char *allocate(void);
+    void release(char *chunk);
+
+    size_t slabCount(void) const { return slabs.size(); }
+    size_t freeCount(void) const { return freeChunks.size(); }
+
+    // the calling thread's pool
+    static BufferPool &local(void);
+};
+
+// Bytes queued for a socket as a chain of pool chunks: appending never moves what is already
+// queued, sending takes the chain as an iovec array for writev(), and every chunk that went out
+// goes straight back to the pool. An empty buffer holds no chunk at all. A buffer must be used and
+// destroyed on the thread that filled it.
+class ChainBuffer
+{
+private:
+    std::vector<char *> chunks;
+    size_t head = 0; // offset of the first unsent byte in chunks.front()
+    size_t tail = 0; // bytes used in chunks.back()
+    size_t bytes = 0;
+
+public:
+    ChainBuffer() = default;
+    ~ChainBuffer();
+    ChainBuffer(const ChainBuffer &) = delete;
+    ChainBuffer &operator=(const ChainBuffer &) = delete;
+    ChainBuffer(ChainBuffer &&other) noexcept;
+    ChainBuffer &operator=(ChainBuffer &&other) noexcept;
+
+    void append(const char *data, size_t len);
+
+    size_t size(void) const { return bytes; }
+    bool empty(void) const { return bytes == 0; }
+
+    // describe up to max chunks of the queued bytes, oldest first; returns how many were filled in
+    int iovecs(iovec *iov, int max) const;
+
+    // drop the first len bytes, they were sent
+    void consume(size_t len);
+
+    void clear(void);
+};
+
+#endif /* A61C9E05_37B2_4D18_8F4A_D2E5B07C1963 */
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "ChunkLog.h"
+
+// copy a field into its fixed-size slot, always terminated
+template <size_t N>
+static void copyField(char (&field)[N], std::string_view value)
+{
+    size_t len = std::min(value.size(), N - 1);
+    memcpy(field, value.data(), len);
+    field[len] = '\0';
+}
+
+ChunkLog::ChunkLog() : slots(new Slot[CAPACITY])
+{
+    // a slot is free for position p when its sequence is p, and holds a record when it is p + 1
+    for (size_t i = 0; i < CAPACITY; i++)
+    {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+ChunkLog::~ChunkLog()
+{
+    close();
+}
+
+bool ChunkLog::open(const std::string &fileName)
+{
+    file.open(fileName);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    writer = std::thread(&ChunkLog::run, this);
+    return true;
+}
+
+void ChunkLog::write(std::string_view browserIp, std::string_view chunkName, std::string_view serverIp,
+                     double duration, double throughput, double avgThroughput, int bitrate)
+{
+    // claim a position; the slot is still being read when the ring is full, wait for the writer then
+    size_t position = tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true)
+    {
+        slot = &slots[position & (CAPACITY - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence == position)
+        {
+            if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (sequence < position)
+        {
+            std::this_thread::yield();
+            position = tail.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            position = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    Record &record = slot->record;
+    copyField(record.browserIp, browserIp);
+    copyField(record.chunkName, chunkName);
+    copyField(record.serverIp, serverIp);
+    record.duration = duration;
+    record.throughput = throughput;
+    record.avgThroughput = avgThroughput;
+    record.bitrate = bitrate;
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+bool ChunkLog::pop(Record &record)
+{
+    Slot &slot = slots[head & (CAPACITY - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+    {
+        return false;
+    }
+    record = slot.record;
+    // hand the slot back for the position one lap later
+    slot.sequence.store(head + CAPACITY, std::memory_order_release);
+    head++;
+    return true;
+}
+
+void ChunkLog::run(void)
+{
+    Record record;
+    while (true)
+    {
+        // format everything queued, then flush the batch with one write
+        bool wrote = false;
+        while (pop(record))
+        {
+            file << record.browserIp << " " << record.chunkName << " " << record.serverIp << " "
+                 << record.duration << " " << record.throughput << " " << record.avgThroughput << " "
+                 << record.bitrate << '\n';
+            wrote = true;
+        }
+        if (wrote)
+        {
+            file.flush();
+        }
+        // records pushed before stopping was set are all popped by the pass above
+        else if (stopping.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_SLEEP_MS));
+        }
+    }
+}
+
+void ChunkLog::close(void)
+{
+    if (writer.joinable())
+    {
+        stopping.store(true, std::memory_order_release);
+        writer.join();
+    }
+    if (file.is_open())
+    {
+        file.close();
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef E82D4C17_6A3F_4B90_9D51_C07B3E8A2F64
+#define E82D4C17_6A3F_4B90_9D51_C07B3E8A2F64
+
+#include <atomic>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// The chunk log. Workers copy each line's fields into a fixed-size record in a bounded lock-free
+// ring (many producers, one consumer); a background thread formats the records and writes them
+// to the file in batches, flushing whenever it has caught up. Logging a chunk is a few stores, no
+// lock and no system call.
+class ChunkLog
+{
+public:
+    // one log line before formatting; longer names are cut to fit
+    struct Record
+    {
+        char browserIp[16];
+        char serverIp[16];
+        char chunkName[96];
+        double duration;
+        double throughput;
+        double avgThroughput;
+        int bitrate;
+    };
+
+    static constexpr size_t CAPACITY = 4096; // records, a power of two
+    // how long the writer sleeps once the ring is empty
+    static constexpr int IDLE_SLEEP_MS = 2;
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<size_t> tail{0}; // next position to claim, shared by the producers
+    alignas(64) size_t head = 0;             // next position to read, writer thread only
+    alignas(64) std::atomic<bool> stopping{false};
+    std::ofstream file;
+    std::thread writer;
+
+    bool pop(Record &record);
+    void run(void);
+
+public:
+    ChunkLog();
+    ~ChunkLog();
+    ChunkLog(const ChunkLog &) = delete;
+    ChunkLog &operator=(const ChunkLog &) = delete;
+
+    // open the file and start the writer thread, false if the file cannot be opened
+    bool open(const std::string &fileName);
+
+    // queue one line: <browser-ip> <chunkname> <server-ip> <duration> <tput> <avg-tput> <bitrate>.
+    // Waits only when the writer is a whole ring behind.
+    void write(std::string_view browserIp, std::string_view chunkName, std::string_view serverIp,
+               double duration, double throughput, double avgThroughput, int bitrate);
+
+    // write out everything queued and stop the writer thread
+    void close(void);
+};
+
+#endif /* E82D4C17_6A3F_4B90_9D51_C07B3E8A2F64 */
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "DnsResolver.h"
+#include "DNS/DNSMessage.h"
+#include "DNS/DNSMessageView.h"
+
+DnsResolver::DnsResolver(const std::string &serverIp, int serverPort) : idGenerator(std::random_device{}())
+{
+    socketFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socketFd < 0)
+    {
+        perror("Resolve socket");
+        exit(1);
+    }
+
+    server.sin_family = AF_INET;
+    server.sin_port = htons(serverPort);
+    if (inet_pton(AF_INET, serverIp.c_str(), &server.sin_addr) != 1)
+    {
+        fprintf(stderr, "Bad nameserver address %s\n", serverIp.c_str());
+        exit(1);
+    }
+
+    // only the nameserver's datagrams get through, anyone else would have to guess the ID too
+    if (connect(socketFd, (struct sockaddr *)&server, sizeof(server)) < 0)
+    {
+        perror("Resolve connect");
+        exit(1);
+    }
+}
+
+DnsResolver::~DnsResolver()
+{
+    close(socketFd);
+}
+
+void DnsResolver::send(Query &query, std::chrono::steady_clock::time_point now)
+{
+    query.attempts++;
+    query.deadline = now + std::chrono::milliseconds(TIMEOUT_MS);
+    // a lost datagram is handled like a lost answer, by the timeout
+    ::send(socketFd, query.packet.data(), query.packet.size(), 0);
+}
+
+std::vector<std::string> DnsResolver::staleAddresses(const std::string &name) const
+{
+    auto cached = cache.find(name);
+    return cached == cache.end() ? std::vector<std::string>() : cached->second.addresses;
+}
+
+std::vector<std::string> DnsResolver::resolve(const std::string &name, uint64_t token)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto cached = cache.find(name);
+    if (cached != cache.end() && cached->second.expires > now)
+    {
+        return cached->second.addresses;
+    }
+
+    // a random ID not used by another outstanding query
+    uint16_t id;
+    do
+    {
+        id = (uint16_t)idGenerator();
+    } while (pending.find(id) != pending.end());
+
+    DNSMessage message;
+    message.header = DNSHeader{};
+    message.header.ID = id;
+    message.header.OPCODE = DNSOpcode::QUERY;
+    message.header.RCODE = DNSRcode::NO_ERROR;
+    message.header.QDCOUNT = 1;
+    message.question.QNAME = DNSDomainName::fromString(name);
+    message.question.QTYPE = DNSQType::A;
+    message.question.QCLASS = DNSQClass::IN;
+
+    Query &query = pending[id];
+    query.name = name;
+    query.token = token;
+    query.packet = message.serialize();
+    send(query, now);
+    return {};
+}
+
+std::vector<DnsResolver::Answer> DnsResolver::receive(void)
+{
+    std::vector<Answer> answers;
+    std::byte buffer[1500];
+    while (true)
+    {
+        ssize_t received = recv(socketFd, buffer, sizeof(buffer), 0);
+        if (received < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            // EINTR, or an ICMP error for an earlier datagram: the timeout deals with that query
+            continue;
+        }
+
+        // parsed in place, nothing is copied out of the datagram but the addresses we keep
+        DNSMessageView response;
+        try
+        {
+            response = DNSMessageView::deserialize(std::span<const std::byte>(buffer, received));
+        }
+        catch (const std::exception &e)
+        {
+            continue;
+        }
+
+        // an answer to a query given up on, or for another question, is dropped
+        auto query = pending.find(response.header.ID);
+        if (response.header.QR != 1 || query == pending.end() || !response.question.QNAME.matches(query->second.name))
+        {
+            continue;
+        }
+
+        std::vector<std::string> addresses;
+        uint32_t ttl = UINT32_MAX;
+        if (response.header.RCODE == DNSRcode::NO_ERROR)
+        {
+            DNSWireReader records = response.answers();
+            for (int i = 0; i < response.header.ANCOUNT; i++)
+            {
+                DNSResourceRecordView answer = DNSResourceRecordView::deserialize(records);
+                if (answer.TYPE == DNSRRType::A && answer.RDLENGTH == 4)
+                {
+                    char text[INET_ADDRSTRLEN];
+                    inet_ntop(AF_INET, answer.RDATA.data(), text, sizeof(text));
+                    addresses.push_back(text);
+                    ttl = std::min(ttl, answer.TTL);
+                }
+            }
+        }
+
+        if (addresses.empty())
+        {
+            addresses = staleAddresses(query->second.name);
+        }
+        else
+        {
+            cache[query->second.name] = {addresses, std::chrono::steady_clock::now() + std::chrono::seconds(ttl)};
+        }
+        answers.push_back({query->second.token, std::move(addresses)});
+        pending.erase(query);
+    }
+    return answers;
+}
+
+std::vector<DnsResolver::Answer> DnsResolver::expire(std::chrono::steady_clock::time_point now)
+{
+    std::vector<Answer> answers;
+    for (auto it = pending.begin(); it != pending.end();)
+    {
+        Query &query = it->second;
+        if (query.deadline > now)
+        {
+            ++it;
+        }
+        else if (query.attempts < MAX_ATTEMPTS)
+        {
+            send(query, now);
+            ++it;
+        }
+        else
+        {
+            answers.push_back({query.token, staleAddresses(query.name)});
+            it = pending.erase(it);
+        }
+    }
+    return answers;
+}
+
+int DnsResolver::nextTimeoutMs(std::chrono::steady_clock::time_point now) const
+{
+    if (pending.empty())
+    {
+        return -1;
+    }
+    auto earliest = std::chrono::steady_clock::time_point::max();
+    for (const auto &entry : pending)
+    {
+        earliest = std::min(earliest, entry.second.deadline);
+    }
+    // rounded up, waking a little late beats spinning until the deadline
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(earliest - now).count();
+    return (int)std::max<int64_t>(wait, 0);
+}
@@ -0,0 +1,78 @@
+#ifndef C5E07A93_4B1D_4F26_A8E3_91D6F02B7C48
+#define C5E07A93_4B1D_4F26_A8E3_91D6F02B7C48
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <netinet/in.h>
+
+// Non-blocking DNS client driven by a worker's event loop. Queries go out on one UDP socket and
+// their answers are matched back by ID; late answers are retried, then given up on. Answers are
+// cached for as long as their TTL allows, so a nameserver answering with TTL 0 is asked every time.
+// Every A record of an answer is kept, in the nameserver's order.
+class DnsResolver
+{
+public:
+    // a lookup that finished, addresses is empty when the name could not be resolved
+    struct Answer
+    {
+        uint64_t token;
+        std::vector<std::string> addresses;
+    };
+
+    static constexpr int TIMEOUT_MS = 500;
+    static constexpr int MAX_ATTEMPTS = 3;
+
+private:
+    struct Query
+    {
+        std::string name;
+        uint64_t token;
+        std::vector<std::byte> packet;
+        std::chrono::steady_clock::time_point deadline;
+        int attempts = 0;
+    };
+
+    struct CachedAddresses
+    {
+        std::vector<std::string> addresses;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    int socketFd;
+    sockaddr_in server{};
+    std::unordered_map<uint16_t, Query> pending; // by query ID
+    std::unordered_map<std::string, CachedAddresses> cache;
+    std::mt19937 idGenerator;
+
+    void send(Query &query, std::chrono::steady_clock::time_point now);
+    // the last answer for name even if its TTL ran out, better than failing the lookup
+    std::vector<std::string> staleAddresses(const std::string &name) const;
+
+public:
+    DnsResolver(const std::string &serverIp, int serverPort);
+    ~DnsResolver();
+    DnsResolver(const DnsResolver &) = delete;
+    DnsResolver &operator=(const DnsResolver &) = delete;
+
+    int fd(void) const { return socketFd; }
+
+    // the cached addresses of name, or none after sending a query whose outcome is later reported
+    // for token by receive() or expire()
+    std::vector<std::string> resolve(const std::string &name, uint64_t token);
+
+    // answers that arrived, read until the socket would block
+    std::vector<Answer> receive(void);
+
+    // resend queries whose answer is late, report the ones out of attempts
+    std::vector<Answer> expire(std::chrono::steady_clock::time_point now);
+
+    // how long the event loop may sleep before a query times out, -1 when none is outstanding
+    int nextTimeoutMs(std::chrono::steady_clock::time_point now) const;
+};
+
+#endif /* C5E07A93_4B1D_4F26_A8E3_91D6F02B7C48 */
@@ -0,0 +1,69 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "EventLoop.h"
+
+EventLoop::EventLoop(int maxEvents) : events(maxEvents)
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+    {
+        perror("epoll_create1");
+        exit(3);
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    close(epollFd);
+}
+
+void EventLoop::add(int fd, uint32_t interest)
+{
+    epoll_event ev{};
+    ev.events = interest;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl add");
+    }
+}
+
+void EventLoop::modify(int fd, uint32_t interest)
+{
+    epoll_event ev{};
+    ev.events = interest;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl mod");
+    }
+}
+
+void EventLoop::remove(int fd)
+{
+    // a closed fd is dropped by the kernel on its own, so ENOENT/EBADF are fine here
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EventLoop::setWriteInterest(int fd, bool enabled)
+{
+    modify(fd, enabled ? (BASE_EVENTS | EPOLLOUT) : BASE_EVENTS);
+}
+
+std::span<epoll_event> EventLoop::wait(int timeoutMs)
+{
+    int ready = epoll_wait(epollFd, events.data(), events.size(), timeoutMs);
+    if (ready < 0)
+    {
+        if (errno == EINTR)
+        {
+            return {};
+        }
+        perror("epoll_wait");
+        exit(3);
+    }
+    return std::span<epoll_event>(events.data(), ready);
+}
@@ -0,0 +1,36 @@
+#ifndef D41F7C2A_8E5B_4B0F_9C36_2A7D51E0B8F4
+#define D41F7C2A_8E5B_4B0F_9C36_2A7D51E0B8F4
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <sys/epoll.h>
+
+// thin wrapper around an edge-triggered epoll instance
+class EventLoop
+{
+private:
+    int epollFd;
+    std::vector<epoll_event> events;
+
+public:
+    // interest flags every registered socket gets; EPOLLOUT is toggled on demand
+    static constexpr uint32_t BASE_EVENTS = EPOLLIN | EPOLLRDHUP | EPOLLET;
+
+    EventLoop(int maxEvents = 1024);
+    ~EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    void add(int fd, uint32_t interest = BASE_EVENTS);
+    void modify(int fd, uint32_t interest);
+    void remove(int fd);
+
+    // turn write readiness notifications on/off for a registered socket
+    void setWriteInterest(int fd, bool enabled);
+
+    // block until at least one registered socket is ready (or timeout), returns the ready set
+    std::span<epoll_event> wait(int timeoutMs = -1);
+};
+
+#endif /* D41F7C2A_8E5B_4B0F_9C36_2A7D51E0B8F4 */
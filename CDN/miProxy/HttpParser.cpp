@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
+#include "HttpParser.h"
+
+// header names and tokens compare case-insensitively
+static bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// whether a comma separated header value lists the token, e.g. "keep-alive, Upgrade"
+static bool hasToken(std::string_view value, std::string_view token)
+{
+    while (!value.empty())
+    {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t'))
+        {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t'))
+        {
+            item.remove_suffix(1);
+        }
+        if (equalsIgnoreCase(item, token))
+        {
+            return true;
+        }
+        value.remove_prefix(comma == std::string_view::npos ? value.size() : comma + 1);
+    }
+    return false;
+}
+
+// next line of a header block without its line ending, advancing past it
+static std::string_view nextLine(std::string_view &rest)
+{
+    size_t lineEnd = rest.find('\n');
+    std::string_view line = rest.substr(0, lineEnd);
+    rest.remove_prefix(lineEnd == std::string_view::npos ? rest.size() : lineEnd + 1);
+    if (!line.empty() && line.back() == '\r')
+    {
+        line.remove_suffix(1);
+    }
+    return line;
+}
+
+// framing and connection headers shared by requests and responses
+class MessageHeaders
+{
+public:
+    bool hasLength = false;
+    size_t contentLength = 0;
+    bool chunked = false;
+    bool close = false;
+    bool keepAlive = false;
+    bool valid = true;
+};
+
+static MessageHeaders parseHeaders(std::string_view lines)
+{
+    MessageHeaders headers;
+    while (!lines.empty())
+    {
+        std::string_view line = nextLine(lines);
+        size_t colon = line.find(':');
+        if (line.empty() || colon == std::string_view::npos)
+        {
+            continue;
+        }
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+        {
+            value.remove_prefix(1);
+        }
+
+        if (equalsIgnoreCase(name, "Content-Length"))
+        {
+            size_t length = 0;
+            size_t digits = 0;
+            while (digits < value.size() && isdigit((unsigned char)value[digits]))
+            {
+                length = length * 10 + (value[digits] - '0');
+                digits++;
+            }
+            if (digits == 0 || digits > 15)
+            {
+                headers.valid = false;
+            }
+            headers.hasLength = true;
+            headers.contentLength = length;
+        }
+        else if (equalsIgnoreCase(name, "Transfer-Encoding"))
+        {
+            headers.chunked = hasToken(value, "chunked");
+        }
+        else if (equalsIgnoreCase(name, "Connection"))
+        {
+            headers.close = headers.close || hasToken(value, "close");
+            headers.keepAlive = headers.keepAlive || hasToken(value, "keep-alive");
+        }
+    }
+    return headers;
+}
+
+void BodyFramer::start(Mode mode, size_t length)
+{
+    bodyMode = mode;
+    left = length;
+    chunkSize = 0;
+    sizeDigits = 0;
+    switch (mode)
+    {
+    case Mode::None:
+        state = State::Done;
+        break;
+    case Mode::Length:
+        state = length == 0 ? State::Done : State::Data;
+        break;
+    case Mode::Chunked:
+        state = State::Size;
+        break;
+    case Mode::UntilClose:
+        state = State::Data;
+        break;
+    }
+}
+
+size_t BodyFramer::consume(const char *data, size_t len, std::string *payload)
+{
+    size_t used = 0;
+    while (used < len && state != State::Done && state != State::Failed)
+    {
+        if (state == State::Data)
+        {
+            // body bytes are skipped in bulk, only the chunk framing is looked at byte by byte
+            size_t n = bodyMode == Mode::UntilClose ? len - used : std::min(left, len - used);
+            if (payload != nullptr)
+            {
+                payload->append(data + used, n);
+            }
+            used += n;
+            if (bodyMode != Mode::UntilClose)
+            {
+                left -= n;
+                if (left == 0)
+                {
+                    state = bodyMode == Mode::Chunked ? State::DataCR : State::Done;
+                }
+            }
+            continue;
+        }
+
+        char c = data[used++];
+        switch (state)
+        {
+        case State::Size:
+            if (isxdigit((unsigned char)c) && sizeDigits < 15)
+            {
+                chunkSize = chunkSize * 16 + (isdigit((unsigned char)c) ? c - '0' : tolower((unsigned char)c) - 'a' + 10);
+                sizeDigits++;
+            }
+            else if (sizeDigits > 0 && (c == ';' || c == ' ' || c == '\t'))
+            {
+                state = State::Extension;
+            }
+            else if (sizeDigits > 0 && c == '\r')
+            {
+                state = State::SizeLF;
+            }
+            else
+            {
+                state = State::Failed;
+            }
+            break;
+        case State::Extension:
+            if (c == '\r')
+            {
+                state = State::SizeLF;
+            }
+            break;
+        case State::SizeLF:
+            if (c != '\n')
+            {
+                state = State::Failed;
+                break;
+            }
+            // the zero-size chunk ends the body, only trailers follow
+            left = chunkSize;
+            state = chunkSize == 0 ? State::TrailerStart : State::Data;
+            chunkSize = 0;
+            sizeDigits = 0;
+            break;
+        case State::DataCR:
+            state = c == '\r' ? State::DataLF : State::Failed;
+            break;
+        case State::DataLF:
+            state = c == '\n' ? State::Size : State::Failed;
+            break;
+        case State::TrailerStart:
+            state = c == '\r' ? State::FinalLF : State::Trailer;
+            break;
+        case State::Trailer:
+            if (c == '\r')
+            {
+                state = State::TrailerLF;
+            }
+            break;
+        case State::TrailerLF:
+            state = c == '\n' ? State::TrailerStart : State::Failed;
+            break;
+        case State::FinalLF:
+            state = c == '\n' ? State::Done : State::Failed;
+            break;
+        default:
+            break;
+        }
+    }
+    return used;
+}
+
+void BodyFramer::advance(size_t len)
+{
+    left -= std::min(left, len);
+    if (left == 0 && bodyMode == Mode::Length)
+    {
+        state = State::Done;
+    }
+}
+
+std::string_view HttpRequest::fileName(void) const
+{
+    std::string_view path = uri.substr(0, uri.find_first_of("?#"));
+    size_t lastSlash = path.rfind('/');
+    return lastSlash == std::string_view::npos ? path : path.substr(lastSlash + 1);
+}
+
+size_t findHeaderEnd(std::string_view buffer, size_t searchFrom)
+{
+    // the blank line may straddle two reads, so look a little before the new bytes
+    searchFrom = searchFrom >= 3 ? searchFrom - 3 : 0;
+    size_t headerEnd = buffer.find("\r\n\r\n", searchFrom);
+    return headerEnd == std::string_view::npos ? 0 : headerEnd + 4;
+}
+
+ParseResult parseRequest(std::string_view buffer, HttpRequest &request)
+{
+    // empty lines ahead of a request are ignored
+    size_t start = 0;
+    while (start < buffer.size() && (buffer[start] == '\r' || buffer[start] == '\n'))
+    {
+        start++;
+    }
+
+    size_t headerEnd = findHeaderEnd(buffer, start);
+    if (headerEnd == 0)
+    {
+        return ParseResult::Incomplete;
+    }
+
+    // request line: METHOD SP URI SP VERSION
+    std::string_view lines = buffer.substr(start, headerEnd - start);
+    std::string_view requestLine = nextLine(lines);
+    size_t methodEnd = requestLine.find(' ');
+    size_t uriEnd = requestLine.rfind(' ');
+    if (methodEnd == std::string_view::npos || uriEnd <= methodEnd + 1)
+    {
+        return ParseResult::Error;
+    }
+    std::string_view version = requestLine.substr(uriEnd + 1);
+    if (!version.starts_with("HTTP/1."))
+    {
+        return ParseResult::Error;
+    }
+
+    MessageHeaders headers = parseHeaders(lines);
+    if (!headers.valid)
+    {
+        return ParseResult::Error;
+    }
+
+    request.method = requestLine.substr(0, methodEnd);
+    request.uri = requestLine.substr(methodEnd + 1, uriEnd - methodEnd - 1);
+    request.uriOffset = start + methodEnd + 1;
+    request.headerLength = headerEnd;
+    request.keepAlive = version == "HTTP/1.0" ? headers.keepAlive : !headers.close;
+
+    // a request only has a body when it says so
+    size_t bodyLength = 0;
+    if (headers.chunked)
+    {
+        BodyFramer framer;
+        framer.start(BodyFramer::Mode::Chunked);
+        bodyLength = framer.consume(buffer.data() + headerEnd, buffer.size() - headerEnd);
+        if (framer.failed())
+        {
+            return ParseResult::Error;
+        }
+        if (!framer.done())
+        {
+            return ParseResult::Incomplete;
+        }
+    }
+    else if (headers.hasLength)
+    {
+        bodyLength = headers.contentLength;
+        if (buffer.size() - headerEnd < bodyLength)
+        {
+            return ParseResult::Incomplete;
+        }
+    }
+
+    request.length = headerEnd + bodyLength;
+    return ParseResult::Complete;
+}
+
+ParseResult parseResponseHead(std::string_view header, bool headRequest, HttpResponseHead &head)
+{
+    // status line: VERSION SP STATUS SP REASON
+    std::string_view lines = header;
+    std::string_view statusLine = nextLine(lines);
+    if (!statusLine.starts_with("HTTP/1.") || statusLine.size() < 12 || statusLine[8] != ' ')
+    {
+        return ParseResult::Error;
+    }
+    int status = 0;
+    for (size_t i = 9; i < 12; i++)
+    {
+        if (!isdigit((unsigned char)statusLine[i]))
+        {
+            return ParseResult::Error;
+        }
+        status = status * 10 + (statusLine[i] - '0');
+    }
+
+    MessageHeaders headers = parseHeaders(lines);
+    if (!headers.valid)
+    {
+        return ParseResult::Error;
+    }
+
+    head.status = status;
+    head.keepAlive = statusLine.starts_with("HTTP/1.0") ? headers.keepAlive : !headers.close;
+    head.contentLength = headers.contentLength;
+
+    if (headRequest || status < 200 || status == 204 || status == 304)
+    {
+        head.bodyMode = BodyFramer::Mode::None;
+    }
+    else if (headers.chunked)
+    {
+        head.bodyMode = BodyFramer::Mode::Chunked;
+    }
+    else if (headers.hasLength)
+    {
+        head.bodyMode = BodyFramer::Mode::Length;
+    }
+    else
+    {
+        // only the server closing the connection ends this body, so it cannot be reused
+        head.bodyMode = BodyFramer::Mode::UntilClose;
+        head.keepAlive = false;
+    }
+    return ParseResult::Complete;
+}
@@ -0,0 +1,107 @@
+#ifndef F3C81B7E_2D64_4A9F_8E15_7B0A4C9D26E3
+#define F3C81B7E_2D64_4A9F_8E15_7B0A4C9D26E3
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Incremental HTTP/1.1 parsing for the proxy. Nothing is copied or allocated: requests are parsed
+// in place in the browser connection's receive buffer and described by offsets into it, response
+// bodies are framed range by range as they stream past.
+
+enum class ParseResult
+{
+    Incomplete, // more bytes are needed
+    Complete,
+    Error
+};
+
+// Where a message body ends
+class BodyFramer
+{
+public:
+    enum class Mode
+    {
+        None,      // no body (HEAD, 204, 304, GET without length)
+        Length,    // Content-Length bytes
+        Chunked,   // Transfer-Encoding: chunked, ends with the zero-size chunk and the trailers
+        UntilClose // no length given, the server closing the connection ends it
+    };
+
+    void start(Mode bodyMode, size_t length = 0);
+
+    // how many of the given bytes belong to the body (chunk framing included), stops at its end;
+    // the body itself, without the framing, is appended to payload when one is given
+    size_t consume(const char *data, size_t len, std::string *payload = nullptr);
+
+    // account for Length body bytes that went by without being looked at (spliced)
+    void advance(size_t len);
+
+    bool done(void) const { return state == State::Done; }
+    bool failed(void) const { return state == State::Failed; }
+    Mode mode(void) const { return bodyMode; }
+
+    // bytes of a Length body still to come
+    size_t remaining(void) const { return left; }
+
+private:
+    enum class State
+    {
+        Data, // also the whole of a Length or UntilClose body
+        Size,
+        Extension,
+        SizeLF,
+        DataCR,
+        DataLF,
+        TrailerStart,
+        Trailer,
+        TrailerLF,
+        FinalLF,
+        Done,
+        Failed
+    };
+
+    Mode bodyMode = Mode::None;
+    State state = State::Done;
+    size_t left = 0;      // bytes left in the Length body or the current chunk
+    size_t chunkSize = 0; // size line being read
+    int sizeDigits = 0;
+};
+
+class HttpRequest
+{
+public:
+    size_t length = 0;       // request line, headers and body
+    size_t headerLength = 0; // through the blank line
+    std::string_view method;
+    std::string_view uri;    // points into the parsed buffer
+    size_t uriOffset = 0;    // uri position in the buffer, for rewriting it by span
+    bool keepAlive = true;   // HTTP/1.1 without "Connection: close"
+
+    // last path segment without the query, e.g. charge_240p_0003.ts
+    std::string_view fileName(void) const;
+    // offset of fileName() in the buffer
+    size_t fileNameOffset(void) const { return uriOffset + (fileName().data() - uri.data()); }
+};
+
+class HttpResponseHead
+{
+public:
+    int status = 0;
+    bool keepAlive = true; // the server will not close after this response
+    BodyFramer::Mode bodyMode = BodyFramer::Mode::None;
+    size_t contentLength = 0;
+};
+
+// One complete request at the front of buffer, or Incomplete until it is all there
+ParseResult parseRequest(std::string_view buffer, HttpRequest &request);
+
+// Offset just past the blank line ending the header in buffer, 0 while it has not arrived. Searching
+// resumes from searchFrom, the bytes before it were already looked at.
+size_t findHeaderEnd(std::string_view buffer, size_t searchFrom = 0);
+
+// A complete response header (through the blank line). headRequest: it answers a HEAD request,
+// so no body follows whatever the header announces.
+ParseResult parseResponseHead(std::string_view header, bool headRequest, HttpResponseHead &head);
+
+#endif /* F3C81B7E_2D64_4A9F_8E15_7B0A4C9D26E3 */
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "ManifestCache.h"
+
+std::shared_ptr<const BitrateLadder> BitrateLadder::parse(std::string_view manifest)
+{
+    std::vector<std::pair<int, std::string>> rungs;
+
+    while (!manifest.empty())
+    {
+        size_t lineEnd = manifest.find('\n');
+        std::string_view line = manifest.substr(0, lineEnd);
+        manifest.remove_prefix(lineEnd == std::string_view::npos ? manifest.size() : lineEnd + 1);
+
+        // find the line that contain the quailty info and bandwith associate with each quality
+        if (!line.starts_with("#EXT-X-STREAM-INF"))
+        {
+            continue;
+        }
+        size_t bwPos = line.find("BANDWIDTH=");
+        size_t nameStart = line.find("NAME=\"");
+        if (bwPos == std::string_view::npos || nameStart == std::string_view::npos)
+        {
+            continue;
+        }
+        nameStart += 6;
+        size_t nameEnd = line.find('"', nameStart);
+        if (nameEnd == std::string_view::npos)
+        {
+            continue;
+        }
+
+        // bandwidth is given in bps, the proxy works in kbps
+        int bandwidth = strtod(line.data() + bwPos + 10, nullptr) / 1000.0;
+        rungs.push_back({bandwidth, std::string(line.substr(nameStart, nameEnd - nameStart)) + "p"});
+    }
+
+    std::sort(rungs.begin(), rungs.end());
+    auto ladder = std::make_shared<BitrateLadder>();
+    for (auto &rung : rungs)
+    {
+        ladder->bandwidths.push_back(rung.first);
+        ladder->qualityNames.push_back(std::move(rung.second));
+    }
+    return ladder;
+}
+
+size_t BitrateLadder::select(double throughput, double multiplier) const
+{
+    // a rung is supported when throughput >= bandwidth * multiplier
+    auto supported = std::upper_bound(bandwidths.begin(), bandwidths.end(), throughput,
+                                      [multiplier](double thru, int bandwidth)
+                                      { return thru < bandwidth * multiplier; });
+    return supported == bandwidths.begin() ? 0 : supported - bandwidths.begin() - 1;
+}
+
+std::shared_ptr<const SegmentTimeline> SegmentTimeline::parse(std::string_view playlist)
+{
+    auto timeline = std::make_shared<SegmentTimeline>();
+
+    while (!playlist.empty())
+    {
+        size_t lineEnd = playlist.find('\n');
+        std::string_view line = playlist.substr(0, lineEnd);
+        playlist.remove_prefix(lineEnd == std::string_view::npos ? playlist.size() : lineEnd + 1);
+
+        // segments are listed in order, each #EXTINF line gives the duration of the next one
+        if (line.starts_with("#EXTINF:"))
+        {
+            timeline->durations.push_back(strtod(line.data() + 8, nullptr));
+        }
+        else if (line.starts_with("#EXT-X-TARGETDURATION:"))
+        {
+            timeline->targetDuration = strtod(line.data() + 22, nullptr);
+        }
+    }
+
+    if (timeline->targetDuration == 0.0 && !timeline->empty())
+    {
+        timeline->targetDuration = *std::max_element(timeline->durations.begin(), timeline->durations.end());
+    }
+    return timeline;
+}
+
+std::shared_ptr<const BitrateLadder> ManifestCache::get(const std::string &videoName)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ladders.find(videoName);
+    return it == ladders.end() ? nullptr : it->second;
+}
+
+void ManifestCache::put(const std::string &videoName, std::shared_ptr<const BitrateLadder> ladder)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ladders[videoName] = std::move(ladder);
+}
+
+std::shared_ptr<const SegmentTimeline> ManifestCache::getTimeline(const std::string &videoName)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = timelines.find(videoName);
+    return it == timelines.end() ? nullptr : it->second;
+}
+
+void ManifestCache::putTimeline(const std::string &videoName, std::shared_ptr<const SegmentTimeline> timeline)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    timelines[videoName] = std::move(timeline);
+}
@@ -0,0 +1,58 @@
+#ifndef E7B20F5C_41D9_4A8E_B6C3_0F9A5D27E186
+#define E7B20F5C_41D9_4A8E_B6C3_0F9A5D27E186
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Bitrates offered by one video, parsed once from its master playlist and never modified
+// afterwards, so sessions on every worker can share it without locking.
+class BitrateLadder
+{
+public:
+    std::vector<int> bandwidths;          // kbps, ascending
+    std::vector<std::string> qualityNames; // e.g. "720p", same order as bandwidths
+
+    static std::shared_ptr<const BitrateLadder> parse(std::string_view manifest);
+
+    bool empty(void) const { return bandwidths.empty(); }
+    int lowest(void) const { return bandwidths.front(); }
+
+    // index of the highest bitrate the throughput supports with the given headroom, 0 if none does
+    size_t select(double throughput, double multiplier) const;
+};
+
+// Segment durations of one video, parsed from the #EXTINF lines of a variant playlist. Every
+// quality of a video is cut at the same points, so one variant describes them all.
+class SegmentTimeline
+{
+public:
+    std::vector<double> durations; // seconds, indexed by segment number
+    double targetDuration = 0.0;   // #EXT-X-TARGETDURATION, used past the end of the list
+
+    static std::shared_ptr<const SegmentTimeline> parse(std::string_view playlist);
+
+    bool empty(void) const { return durations.empty(); }
+    double duration(size_t segment) const { return segment < durations.size() ? durations[segment] : targetDuration; }
+};
+
+// Parsed playlists keyed by video name ("charge", "wing_it"), shared by all workers.
+class ManifestCache
+{
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<const BitrateLadder>> ladders;
+    std::unordered_map<std::string, std::shared_ptr<const SegmentTimeline>> timelines;
+
+public:
+    std::shared_ptr<const BitrateLadder> get(const std::string &videoName);
+    void put(const std::string &videoName, std::shared_ptr<const BitrateLadder> ladder);
+
+    std::shared_ptr<const SegmentTimeline> getTimeline(const std::string &videoName);
+    void putTimeline(const std::string &videoName, std::shared_ptr<const SegmentTimeline> timeline);
+};
+
+#endif /* E7B20F5C_41D9_4A8E_B6C3_0F9A5D27E186 */
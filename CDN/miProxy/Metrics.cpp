@@ -0,0 +1,265 @@
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Metrics.h"
+
+static const std::vector<double> LATENCY_BOUNDS = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+static const std::vector<double> LOOP_BOUNDS = {0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.1};
+
+Histogram::Histogram(std::vector<double> upperBounds)
+    : bounds(std::move(upperBounds)), counts(new std::atomic<uint64_t>[bounds.size() + 1])
+{
+    for (size_t i = 0; i <= bounds.size(); i++)
+    {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::observe(double value)
+{
+    size_t i = 0;
+    while (i < bounds.size() && value > bounds[i])
+    {
+        i++;
+    }
+    counts[i].store(counts[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    total.store(total.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+WorkerMetrics::WorkerMetrics() : chunkSeconds(LATENCY_BOUNDS), connectSeconds(LATENCY_BOUNDS), loopIterationSeconds(LOOP_BOUNDS)
+{
+}
+
+void WorkerMetrics::countBitrate(const std::string &videoName, int bitrate)
+{
+    std::lock_guard<std::mutex> lock(bitrateMutex);
+    bitrates[{videoName, bitrate}]++;
+}
+
+std::map<std::pair<std::string, int>, uint64_t> WorkerMetrics::bitrateCounts(void)
+{
+    std::lock_guard<std::mutex> lock(bitrateMutex);
+    return bitrates;
+}
+
+WorkerMetrics *MetricsRegistry::addWorker(void)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    workers.push_back(std::make_unique<WorkerMetrics>());
+    return workers.back().get();
+}
+
+// label values may not contain raw quotes, backslashes or newlines
+static std::string escapeLabel(const std::string &value)
+{
+    std::string escaped;
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c == '\n')
+        {
+            escaped += "\\n";
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+// one histogram summed over the workers, with cumulative buckets
+static void renderHistogram(std::ostringstream &out, const std::string &name, const std::string &help,
+                            const std::vector<std::unique_ptr<WorkerMetrics>> &workers, Histogram WorkerMetrics::*member)
+{
+    const std::vector<double> &bounds = (workers.front().get()->*member).upperBounds();
+    std::vector<uint64_t> buckets(bounds.size() + 1, 0);
+    double sum = 0.0;
+    for (const auto &worker : workers)
+    {
+        const Histogram &histogram = worker.get()->*member;
+        for (size_t i = 0; i < buckets.size(); i++)
+        {
+            buckets[i] += histogram.bucket(i);
+        }
+        sum += histogram.sum();
+    }
+
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " histogram\n";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < buckets.size(); i++)
+    {
+        cumulative += buckets[i];
+        out << name << "_bucket{le=\"";
+        if (i < bounds.size())
+        {
+            out << bounds[i];
+        }
+        else
+        {
+            out << "+Inf";
+        }
+        out << "\"} " << cumulative << "\n";
+    }
+    out << name << "_sum " << sum << "\n" << name << "_count " << cumulative << "\n";
+}
+
+std::string MetricsRegistry::render(void)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    if (workers.empty())
+    {
+        return "";
+    }
+
+    int64_t connections = 0;
+    uint64_t fromBrowsers = 0, toBrowsers = 0, hits = 0, waits = 0, misses = 0;
+    std::map<std::pair<std::string, int>, uint64_t> bitrates;
+    for (const auto &worker : workers)
+    {
+        connections += worker->browserConnections.get();
+        fromBrowsers += worker->bytesFromBrowsers.get();
+        toBrowsers += worker->bytesToBrowsers.get();
+        hits += worker->cacheHits.get();
+        waits += worker->cacheWaits.get();
+        misses += worker->cacheMisses.get();
+        for (const auto &entry : worker->bitrateCounts())
+        {
+            bitrates[entry.first] += entry.second;
+        }
+    }
+
+    out << "# HELP miproxy_browser_connections Browser connections currently open.\n"
+        << "# TYPE miproxy_browser_connections gauge\n"
+        << "miproxy_browser_connections " << connections << "\n";
+
+    out << "# HELP miproxy_relayed_bytes_total Bytes relayed, by direction.\n"
+        << "# TYPE miproxy_relayed_bytes_total counter\n"
+        << "miproxy_relayed_bytes_total{direction=\"browser_to_origin\"} " << fromBrowsers << "\n"
+        << "miproxy_relayed_bytes_total{direction=\"origin_to_browser\"} " << toBrowsers << "\n";
+
+    out << "# HELP miproxy_cache_lookups_total Segment cache lookups, by result.\n"
+        << "# TYPE miproxy_cache_lookups_total counter\n"
+        << "miproxy_cache_lookups_total{result=\"hit\"} " << hits << "\n"
+        << "miproxy_cache_lookups_total{result=\"wait\"} " << waits << "\n"
+        << "miproxy_cache_lookups_total{result=\"miss\"} " << misses << "\n";
+    uint64_t lookups = hits + waits + misses;
+    out << "# HELP miproxy_cache_hit_ratio Share of segment cache lookups answered without a fetch of their own.\n"
+        << "# TYPE miproxy_cache_hit_ratio gauge\n"
+        << "miproxy_cache_hit_ratio " << (lookups == 0 ? 0.0 : (double)(hits + waits) / lookups) << "\n";
+
+    out << "# HELP miproxy_chunks_total Chunks served, by video and selected bitrate (kbps).\n"
+        << "# TYPE miproxy_chunks_total counter\n";
+    for (const auto &entry : bitrates)
+    {
+        out << "miproxy_chunks_total{video=\"" << escapeLabel(entry.first.first) << "\",bitrate=\""
+            << entry.first.second << "\"} " << entry.second << "\n";
+    }
+
+    renderHistogram(out, "miproxy_chunk_seconds", "Time from request to last byte of each chunk served.",
+                    workers, &WorkerMetrics::chunkSeconds);
+    renderHistogram(out, "miproxy_upstream_connect_seconds", "Time to open a new upstream connection.",
+                    workers, &WorkerMetrics::connectSeconds);
+    renderHistogram(out, "miproxy_loop_iteration_seconds", "Time to handle one batch of epoll events.",
+                    workers, &WorkerMetrics::loopIterationSeconds);
+    return out.str();
+}
+
+// one scrape per connection, answered and closed
+static void serveScrape(MetricsRegistry &registry, int client)
+{
+    // a client that never finishes its request cannot hold up the next scrape for long
+    timeval timeout = {1, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192)
+    {
+        ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+        {
+            return;
+        }
+        request.append(buffer, n);
+    }
+
+    std::string body;
+    std::string status;
+    if (request.starts_with("GET /metrics ") || request.starts_with("GET /metrics?"))
+    {
+        status = "200 OK";
+        body = registry.render();
+    }
+    else
+    {
+        status = "404 Not Found";
+        body = "try /metrics\n";
+    }
+    std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                           std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+    size_t sent = 0;
+    while (sent < response.size())
+    {
+        ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return;
+        }
+        sent += n;
+    }
+}
+
+static void acceptScrapes(MetricsRegistry *registry, int listenSocket)
+{
+    while (true)
+    {
+        int client = accept(listenSocket, nullptr, nullptr);
+        if (client < 0)
+        {
+            continue;
+        }
+        serveScrape(*registry, client);
+        close(client);
+    }
+}
+
+bool startMetricsServer(MetricsRegistry &registry, const std::string &host, int port)
+{
+    int listenSocket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenSocket < 0)
+    {
+        perror("Metrics socket");
+        return false;
+    }
+    int opt = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 ||
+        bind(listenSocket, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenSocket, 16) < 0)
+    {
+        perror("Metrics listen");
+        close(listenSocket);
+        return false;
+    }
+
+    // scrapes are rare and small, a blocking thread of its own keeps them off the workers' loops
+    std::thread(acceptScrapes, &registry, listenSocket).detach();
+    return true;
+}
@@ -0,0 +1,102 @@
+#ifndef D06B3F82_C5E1_4A7D_B924_8E1F7A60C3D5
+#define D06B3F82_C5E1_4A7D_B924_8E1F7A60C3D5
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Live counters for the admin listener (--metrics-port). Every worker owns its own set and is the
+// only one writing to it, so updating a metric is a plain relaxed load and store without a locked
+// instruction; a scrape reads all the sets and adds them up.
+
+class Counter
+{
+private:
+    std::atomic<uint64_t> value{0};
+
+public:
+    void add(uint64_t n = 1) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    uint64_t get(void) const { return value.load(std::memory_order_relaxed); }
+};
+
+class Gauge
+{
+private:
+    std::atomic<int64_t> value{0};
+
+public:
+    void add(int64_t n) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    int64_t get(void) const { return value.load(std::memory_order_relaxed); }
+};
+
+// observations counted into buckets by upper bound, as Prometheus histograms are
+class Histogram
+{
+private:
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts; // one per bound, then the +Inf bucket
+    std::atomic<double> total{0.0};
+
+public:
+    explicit Histogram(std::vector<double> upperBounds);
+
+    void observe(double value);
+
+    const std::vector<double> &upperBounds(void) const { return bounds; }
+    // observations in bucket i alone (not cumulative), i == upperBounds().size() is +Inf
+    uint64_t bucket(size_t i) const { return counts[i].load(std::memory_order_relaxed); }
+    double sum(void) const { return total.load(std::memory_order_relaxed); }
+};
+
+// everything one worker measures
+class WorkerMetrics
+{
+private:
+    // chunks served per video and bitrate; the lock is only ever contended by a scrape
+    std::mutex bitrateMutex;
+    std::map<std::pair<std::string, int>, uint64_t> bitrates;
+
+public:
+    Gauge browserConnections;
+    Counter bytesFromBrowsers; // requests as received
+    Counter bytesToBrowsers;   // responses relayed, spliced or served from the cache
+    Counter cacheHits;
+    Counter cacheWaits; // coalesced onto a fetch already running
+    Counter cacheMisses;
+    Histogram chunkSeconds;         // request to last byte of every chunk served
+    Histogram connectSeconds;       // new upstream connections
+    Histogram loopIterationSeconds; // handling one batch of epoll events
+
+    WorkerMetrics();
+
+    void countBitrate(const std::string &videoName, int bitrate);
+
+    // a copy of the per-bitrate counts, for the scrape
+    std::map<std::pair<std::string, int>, uint64_t> bitrateCounts(void);
+};
+
+// the metric sets of all workers
+class MetricsRegistry
+{
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<WorkerMetrics>> workers;
+
+public:
+    // a new set for the calling worker, it lives as long as the registry
+    WorkerMetrics *addWorker(void);
+
+    // all sets merged, in the Prometheus text exposition format
+    std::string render(void);
+};
+
+// Answer GET /metrics with registry.render() on host:port from a background thread. Returns false
+// when the port cannot be bound.
+bool startMetricsServer(MetricsRegistry &registry, const std::string &host, int port);
+
+#endif /* D06B3F82_C5E1_4A7D_B924_8E1F7A60C3D5 */
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "OriginPool.h"
+
+OriginPool::OriginPool(int originPort) : port(originPort)
+{
+}
+
+OriginPool::~OriginPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(probeMutex);
+        stopping = true;
+    }
+    probeWake.notify_all();
+    if (prober.joinable())
+    {
+        prober.join();
+    }
+}
+
+OriginPool::Origin *OriginPool::find(const std::string &address)
+{
+    for (Origin &origin : origins)
+    {
+        if (origin.address == address)
+        {
+            return &origin;
+        }
+    }
+    return nullptr;
+}
+
+void OriginPool::add(const std::string &address)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (find(address) == nullptr)
+    {
+        Origin origin;
+        origin.address = address;
+        origins.push_back(origin);
+    }
+}
+
+std::string OriginPool::select(const std::string &preferred) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const Origin *best = nullptr;
+    double bestWait = 0.0;
+    for (const Origin &origin : origins)
+    {
+        if (!origin.healthy)
+        {
+            continue;
+        }
+        if (origin.address == preferred)
+        {
+            return preferred;
+        }
+        double wait = (origin.outstanding + 1) * std::max(origin.latency, MIN_LATENCY_SECONDS);
+        if (best == nullptr || wait < bestWait)
+        {
+            best = &origin;
+            bestWait = wait;
+        }
+    }
+    return best == nullptr ? "" : best->address;
+}
+
+void OriginPool::requestSent(const std::string &address)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Origin *origin = find(address);
+    if (origin != nullptr)
+    {
+        origin->outstanding++;
+    }
+}
+
+void OriginPool::responseReceived(const std::string &address, double waitSeconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Origin *origin = find(address);
+    if (origin == nullptr)
+    {
+        return;
+    }
+    origin->outstanding = std::max(origin->outstanding - 1, 0);
+    origin->latency = origin->latency == 0.0 ? waitSeconds : LATENCY_GAIN * waitSeconds + (1 - LATENCY_GAIN) * origin->latency;
+}
+
+void OriginPool::requestFailed(const std::string &address)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Origin *origin = find(address);
+    if (origin != nullptr)
+    {
+        origin->outstanding = std::max(origin->outstanding - 1, 0);
+    }
+}
+
+void OriginPool::markDown(const std::string &address)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Origin *origin = find(address);
+    if (origin != nullptr && origin->healthy)
+    {
+        origin->healthy = false;
+        std::cerr << "Origin " << address << " is down" << std::endl;
+    }
+}
+
+std::vector<OriginPool::Status> OriginPool::snapshot(void) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Status> statuses;
+    for (const Origin &origin : origins)
+    {
+        statuses.push_back({origin.address, origin.healthy, origin.outstanding, origin.latency});
+    }
+    return statuses;
+}
+
+// an origin is up when it answers a HEAD request with any HTTP status line
+bool OriginPool::probe(const std::string &address) const
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+    {
+        return false;
+    }
+
+    int s = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0)
+    {
+        return false;
+    }
+    // bounds connect() as well as the exchange
+    timeval timeout = {PROBE_TIMEOUT_MS / 1000, (PROBE_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    bool up = false;
+    if (connect(s, (sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+        std::string request = "HEAD / HTTP/1.1\r\nHost: " + address + ":" + std::to_string(port) + "\r\nConnection: close\r\n\r\n";
+        char reply[16];
+        if (send(s, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size())
+        {
+            ssize_t n = recv(s, reply, sizeof(reply), MSG_WAITALL);
+            up = n >= 7 && memcmp(reply, "HTTP/1.", 7) == 0;
+        }
+    }
+    close(s);
+    return up;
+}
+
+void OriginPool::runProbes(void)
+{
+    std::unique_lock<std::mutex> wait(probeMutex);
+    while (!probeWake.wait_for(wait, std::chrono::milliseconds(PROBE_INTERVAL_MS), [this] { return stopping; }))
+    {
+        // probes block, so none runs under the lock select() takes
+        std::vector<Status> statuses = snapshot();
+        for (const Status &status : statuses)
+        {
+            bool up = probe(status.address);
+            std::lock_guard<std::mutex> lock(mutex);
+            Origin *origin = find(status.address);
+            if (origin != nullptr && origin->healthy != up)
+            {
+                origin->healthy = up;
+                std::cerr << "Origin " << status.address << (up ? " is back up" : " is down") << std::endl;
+            }
+        }
+    }
+}
+
+void OriginPool::startProbing(void)
+{
+    prober = std::thread(&OriginPool::runProbes, this);
+}
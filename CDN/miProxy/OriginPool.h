@@ -0,0 +1,88 @@
+#ifndef C4F17A92_5E08_4B3D_A6C1_8D29E0B743F5
+#define C4F17A92_5E08_4B3D_A6C1_8D29E0B743F5
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The origin servers requests are spread over, shared by all workers. Each origin keeps how many
+// requests it has outstanding and an EWMA of its time to first byte; a new server connection goes
+// to the healthy origin with the smallest expected wait, (outstanding + 1) x latency, so a slow or
+// busy box gets less work and origins that behave the same get the fewest outstanding requests.
+// An origin is marked down when connecting to it fails and comes back once a background probe
+// gets an HTTP answer from it again.
+class OriginPool
+{
+public:
+    // weight of a new latency sample
+    static constexpr double LATENCY_GAIN = 0.3;
+    // latency assumed until an origin has been measured, and the floor of every estimate
+    static constexpr double MIN_LATENCY_SECONDS = 0.001;
+    static constexpr int PROBE_INTERVAL_MS = 2000;
+    static constexpr int PROBE_TIMEOUT_MS = 1000;
+
+    // state of one origin as seen by select()
+    struct Status
+    {
+        std::string address;
+        bool healthy;
+        int outstanding;
+        double latencySeconds;
+    };
+
+private:
+    struct Origin
+    {
+        std::string address;
+        bool healthy = true;
+        int outstanding = 0;
+        double latency = 0.0; // seconds, 0 until the first response
+    };
+
+    int port;
+    mutable std::mutex mutex;
+    std::vector<Origin> origins;
+
+    std::mutex probeMutex;
+    std::condition_variable probeWake;
+    bool stopping = false;
+    std::thread prober;
+
+    Origin *find(const std::string &address);
+    bool probe(const std::string &address) const;
+    void runProbes(void);
+
+public:
+    explicit OriginPool(int originPort);
+    ~OriginPool();
+    OriginPool(const OriginPool &) = delete;
+    OriginPool &operator=(const OriginPool &) = delete;
+
+    // an origin requests may go to, known ones are left as they are
+    void add(const std::string &address);
+
+    // origin for a new server connection: the preferred one while it is healthy (the nameserver's
+    // pick, empty for none), otherwise the healthy origin with the smallest expected wait; empty
+    // when every origin is down
+    std::string select(const std::string &preferred) const;
+
+    // a request went out to the origin
+    void requestSent(const std::string &address);
+    // its response started arriving after waitSeconds
+    void responseReceived(const std::string &address, double waitSeconds);
+    // its response will never come, the connection closed first
+    void requestFailed(const std::string &address);
+
+    // connecting failed, no new connection goes there until a probe succeeds
+    void markDown(const std::string &address);
+
+    std::vector<Status> snapshot(void) const;
+
+    // probe every origin in the background every PROBE_INTERVAL_MS
+    void startProbing(void);
+};
+
+#endif /* C4F17A92_5E08_4B3D_A6C1_8D29E0B743F5 */
@@ -0,0 +1,150 @@
+#include <cstdio>
+#include <cstdlib>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "SegmentCache.h"
+
+CacheMailbox::CacheMailbox()
+{
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd < 0)
+    {
+        perror("eventfd");
+        exit(1);
+    }
+}
+
+CacheMailbox::~CacheMailbox()
+{
+    close(eventFd);
+}
+
+void CacheMailbox::post(Delivery delivery)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        deliveries.push_back(std::move(delivery));
+    }
+    uint64_t one = 1;
+    if (write(eventFd, &one, sizeof(one)) < 0)
+    {
+        // counter overflow only, the worker is woken up either way
+    }
+}
+
+std::deque<CacheMailbox::Delivery> CacheMailbox::take(void)
+{
+    uint64_t count;
+    if (read(eventFd, &count, sizeof(count)) < 0)
+    {
+        // EAGAIN, nothing signalled since the last take
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::deque<Delivery> taken;
+    taken.swap(deliveries);
+    return taken;
+}
+
+SegmentCache::SegmentCache(size_t budgetBytes) : budget(budgetBytes) {}
+
+SegmentCache::Lookup SegmentCache::acquire(const std::string &key, const Waiter &waiter, CachedResponse &response)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it == entries.end())
+    {
+        // first miss, this session fetches and everyone else waits on it
+        entries[key] = Entry();
+        return Lookup::Fetch;
+    }
+
+    Entry &entry = it->second;
+    if (entry.response == nullptr)
+    {
+        entry.waiters.push_back(waiter);
+        return Lookup::Wait;
+    }
+
+    lru.splice(lru.begin(), lru, entry.lru);
+    response = entry.response;
+    return Lookup::Hit;
+}
+
+bool SegmentCache::reserve(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.find(key) != entries.end())
+    {
+        return false;
+    }
+    entries[key] = Entry();
+    return true;
+}
+
+void SegmentCache::fill(const std::string &key, std::vector<char> response)
+{
+    CachedResponse shared = std::make_shared<const std::vector<char>>(std::move(response));
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it == entries.end())
+        {
+            return;
+        }
+        waiters.swap(it->second.waiters);
+
+        if (shared->size() <= maxEntrySize())
+        {
+            it->second.response = shared;
+            lru.push_front(key);
+            it->second.lru = lru.begin();
+            used += shared->size();
+            evict();
+        }
+        else
+        {
+            entries.erase(it);
+        }
+    }
+
+    // hand the response to the parked sessions outside the lock
+    for (const Waiter &waiter : waiters)
+    {
+        waiter.mailbox->post({waiter.clientSocket, waiter.sessionId, shared});
+    }
+}
+
+void SegmentCache::abandon(const std::string &key)
+{
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it == entries.end() || it->second.response != nullptr)
+        {
+            return;
+        }
+        waiters.swap(it->second.waiters);
+        entries.erase(it);
+    }
+
+    // parked sessions go fetch the segment on their own
+    for (const Waiter &waiter : waiters)
+    {
+        waiter.mailbox->post({waiter.clientSocket, waiter.sessionId, nullptr});
+    }
+}
+
+// drop least recently used segments until the budget holds again, caller holds the lock
+void SegmentCache::evict(void)
+{
+    while (used > budget && !lru.empty())
+    {
+        auto it = entries.find(lru.back());
+        used -= it->second.response->size();
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
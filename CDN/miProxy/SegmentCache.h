@@ -0,0 +1,94 @@
+#ifndef A3C9E146_0B7D_4E52_8F1A_6D2B94C7E035
+#define A3C9E146_0B7D_4E52_8F1A_6D2B94C7E035
+
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// a cached response, shared read-only between every session it is served to
+using CachedResponse = std::shared_ptr<const std::vector<char>>;
+
+// Per worker inbox for cache results. The worker that finishes a fetch posts the response to
+// every session waiting on it; the owning worker picks it up from its event loop via the eventfd.
+class CacheMailbox
+{
+public:
+    struct Delivery
+    {
+        int clientSocket;
+        uint64_t sessionId;       // guards against the socket number having been reused meanwhile
+        CachedResponse response; // nullptr when the fetch was abandoned and the session must fetch itself
+    };
+
+private:
+    int eventFd;
+    std::mutex mutex;
+    std::deque<Delivery> deliveries;
+
+public:
+    CacheMailbox();
+    ~CacheMailbox();
+    CacheMailbox(const CacheMailbox &) = delete;
+    CacheMailbox &operator=(const CacheMailbox &) = delete;
+
+    int fd(void) const { return eventFd; }
+    void post(Delivery delivery);
+    // empty the inbox, called by the owning worker when the eventfd is readable
+    std::deque<Delivery> take(void);
+};
+
+// Byte-bounded LRU cache of whole segment responses shared by all workers, keyed by the
+// rewritten chunk name. Concurrent misses for the same key are coalesced into one fetch.
+class SegmentCache
+{
+public:
+    enum class Lookup
+    {
+        Hit,   // response returned right away
+        Fetch, // caller is the only one fetching this key, it must call fill() or abandon()
+        Wait   // someone is already fetching it, the response arrives through the mailbox
+    };
+
+    struct Waiter
+    {
+        CacheMailbox *mailbox;
+        int clientSocket;
+        uint64_t sessionId;
+    };
+
+private:
+    struct Entry
+    {
+        CachedResponse response;            // nullptr while the fetch is in flight
+        std::vector<Waiter> waiters;        // sessions parked on the in-flight fetch
+        std::list<std::string>::iterator lru; // position in the recency list once filled
+    };
+
+    std::mutex mutex;
+    size_t budget;
+    size_t used = 0;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru; // most recently used at the front, filled entries only
+
+    void evict(void);
+
+public:
+    SegmentCache(size_t budgetBytes);
+
+    // responses larger than this are relayed but never cached
+    size_t maxEntrySize(void) const { return budget / 4; }
+
+    Lookup acquire(const std::string &key, const Waiter &waiter, CachedResponse &response);
+    // start a fetch nobody is waiting on yet (prefetch), false if the key is cached or being fetched;
+    // on true the caller must call fill() or abandon() like after Lookup::Fetch
+    bool reserve(const std::string &key);
+    void fill(const std::string &key, std::vector<char> response);
+    void abandon(const std::string &key);
+};
+
+#endif /* A3C9E146_0B7D_4E52_8F1A_6D2B94C7E035 */
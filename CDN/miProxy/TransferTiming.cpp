@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "TransferTiming.h"
+
+double TransferTiming::seconds(void) const
+{
+    return std::max(std::chrono::duration<double>(lastByte - requestSent).count(), MIN_SECONDS);
+}
+
+double TransferTiming::waitSeconds(void) const
+{
+    return std::max(std::chrono::duration<double>(firstByte - requestSent).count(), 0.0);
+}
+
+double TransferTiming::throughputKbps(void) const
+{
+    // never below the time the body itself took to arrive, the RTT is an average
+    double transfer = seconds();
+    if (rttMicros > 0)
+    {
+        double body = std::chrono::duration<double>(lastByte - firstByte).count();
+        transfer = std::max({transfer - rttMicros / 1e6, body, MIN_SECONDS});
+    }
+    return bytes * 8.0 / transfer / 1000.0;
+}
+
+void TransferTiming::sampleKernel(int socket)
+{
+    // the proxy only sends requests on this connection, so the kernel's delivery rate says nothing
+    // about the origin, but the RTT measured from the ACKs of those requests does
+    tcp_info info{};
+    socklen_t len = sizeof(info);
+    if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+    {
+        return;
+    }
+    rttMicros = info.tcpi_rtt;
+}
@@ -0,0 +1,41 @@
+#ifndef B7F40C2E_913A_4D85_A6E1_5C28D9F3B017
+#define B7F40C2E_913A_4D85_A6E1_5C28D9F3B017
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// How one response from the origin was delivered, timed with the steady clock at full resolution
+// (nothing is rounded to milliseconds). Optionally the kernel's view of the origin connection is
+// sampled too.
+class TransferTiming
+{
+public:
+    // a transfer shorter than this is treated as taking this long, so a throughput always exists
+    static constexpr double MIN_SECONDS = 1e-6;
+
+    // the request went out, or the response before it on the same connection ended (pipelining)
+    std::chrono::steady_clock::time_point requestSent;
+    std::chrono::steady_clock::time_point firstByte;
+    std::chrono::steady_clock::time_point lastByte;
+    size_t bytes = 0;
+
+    // smoothed round trip time of the origin connection from TCP_INFO, 0 when not sampled
+    uint32_t rttMicros = 0;
+
+    // seconds from the request to the last byte, so the round trip and server time are included
+    // as a player would see them
+    double seconds(void) const;
+
+    // time to the first byte in seconds
+    double waitSeconds(void) const;
+
+    // what the bitrate selection is fed: bytes over seconds(), less the round trip the request took
+    // when it was sampled, as that time is spent whatever the bitrate (it swamps small chunks)
+    double throughputKbps(void) const;
+
+    // read TCP_INFO of the connection the response came in on, rttMicros stays 0 if that fails
+    void sampleKernel(int socket);
+};
+
+#endif /* B7F40C2E_913A_4D85_A6E1_5C28D9F3B017 */
@@ -0,0 +1,42 @@
+#include <algorithm>
+
+#include "UpstreamPool.h"
+
+int UpstreamPool::borrow(const std::string &origin)
+{
+    auto it = idle.find(origin);
+    if (it == idle.end() || it->second.empty())
+    {
+        return -1;
+    }
+    // the warmest connection is the least likely to have been timed out by the server
+    int socket = it->second.back();
+    it->second.pop_back();
+    idleOrigin.erase(socket);
+    return socket;
+}
+
+bool UpstreamPool::giveBack(const std::string &origin, int socket)
+{
+    std::vector<int> &sockets = idle[origin];
+    if (sockets.size() >= maxIdlePerOrigin)
+    {
+        return false;
+    }
+    sockets.push_back(socket);
+    idleOrigin[socket] = origin;
+    return true;
+}
+
+bool UpstreamPool::forget(int socket)
+{
+    auto it = idleOrigin.find(socket);
+    if (it == idleOrigin.end())
+    {
+        return false;
+    }
+    std::vector<int> &sockets = idle[it->second];
+    sockets.erase(std::find(sockets.begin(), sockets.end(), socket));
+    idleOrigin.erase(it);
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef B6E2941D_0F7A_4C85_8D3B_E59A17C6024F
+#define B6E2941D_0F7A_4C85_8D3B_E59A17C6024F
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Idle keep-alive connections to the origin servers, keyed by "ip:port". Each worker has its own
+// pool since the sockets are registered with that worker's event loop.
+class UpstreamPool
+{
+private:
+    size_t maxIdlePerOrigin;
+    std::unordered_map<std::string, std::vector<int>> idle; // most recently returned last
+    std::unordered_map<int, std::string> idleOrigin;
+
+public:
+    explicit UpstreamPool(size_t maxIdle = 32) : maxIdlePerOrigin(maxIdle) {}
+
+    // most recently used idle connection to the origin, -1 if there is none
+    int borrow(const std::string &origin);
+
+    // park a connection whose response completed, false if the pool is full and it should be closed
+    bool giveBack(const std::string &origin, int socket);
+
+    // take an idle connection out of the pool because it closed, false if it was not idle
+    bool forget(int socket);
+};
+
+#endif /* B6E2941D_0F7A_4C85_8D3B_E59A17C6024F */
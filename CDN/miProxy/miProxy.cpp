@@ -5,8 +5,9 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/in.h>
-#include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <cstring>
@@ -14,17 +15,32 @@
 #include <algorithm>
 #include <sstream>
 #include <vector>
+#include <deque>
+#include <initializer_list>
+#include <string_view>
 #include <ctime>
 #include <chrono>
-#include "DNS/DNSMessage.h"
-#include "DNS/DNSDomainName.h"
+#include <mutex>
+#include <thread>
+#include "EventLoop.h"
+#include "SegmentCache.h"
+#include "ManifestCache.h"
+#include "AbrSession.h"
+#include "AbrPolicy.h"
+#include "UpstreamPool.h"
+#include "HttpParser.h"
+#include "DnsResolver.h"
+#include "ChunkLog.h"
+#include "Metrics.h"
+#include "BufferPool.h"
+#include "OriginPool.h"
 
 class Argument
 {
 public:
     std::string proxy_host = "";
     int proxy_port = 0;
-    std::string upstream_host_ip = "";
+    std::vector<std::string> upstream_host_ips;
     std::string upstream_host_name = "";
     int upstream_port = 0;
     double adap_gain = 0;
@@ -32,32 +48,19 @@ public:
     std::string nameserver_ip = "";
     int nameserver_port = 0;
     std::string log_file_name = "log.txt";
+    bool splice_bodies = false;
+    bool tcp_info = false;
+    int metrics_port = 0;
+    int workers = 1;
+    int cache_size_mb = 0;
+    std::string abr = "throughput";
+    int prefetch = 0;
 };
 
-class ClientState
-{
-public:
-    std::vector<char> buf;
-    int contentLength = 0;
-    int totalBytes = 0;
-    bool gotHeader = false;
-    std::vector<int> clientSockets;
-};
-
-class ManifestArgs
-{
-public:
-    int bandwidth = 0;
-    std::string qualityName = "";
-};
-
-// data used for logging info
+// data used for logging info, one per request in flight
 class LogData
 {
 public:
-    std::chrono::steady_clock::time_point startTime;
-    std::chrono::steady_clock::time_point endTime;
-    int LowestBitrate;
     std::string browserIp = "";
     std::string chunkName = "";
     std::string serverIp = "";
@@ -69,86 +72,409 @@ public:
     std::string videoName = "";
 };
 
+// a request forwarded on an upstream connection and still waiting for its response
+class InFlightRequest
+{
+public:
+    LogData log;                         // who asked for this response and, for chunks, at which bitrate
+    std::shared_ptr<AbrSession> session; // viewer whose estimate this chunk feeds
+    std::string requestName = "";       // file the browser asked for, e.g. charge.m3u8
+    std::string cacheKey = "";           // set when this response fills the segment cache
+    bool headRequest = false;            // the response to a HEAD has no body
+    bool prefetch = false;               // fetched ahead for the session, goes only into the cache
+    std::chrono::steady_clock::time_point sentAt; // handed to the upstream connection
+};
+
+// progress of the response currently being relayed on an upstream connection
+class ResponseState
+{
+public:
+    std::string header = ""; // header bytes seen so far, complete once the blank line arrived
+    bool gotHeader = false;
+    HttpResponseHead head;
+    BodyFramer body;
+    int totalBytes = 0; // header + body bytes relayed to the browser
+    bool isManifest = false;
+    std::string manifest = ""; // playlist bodies are kept to learn the available bitrates
+    bool paused = false;       // reading stopped until the browser drains what is queued
+    bool splicing = false;     // body is being moved socket to socket through the pipe
+    std::vector<char> cacheBuffer;
+    TransferTiming timing;
+
+    // kept across responses: they describe the connection rather than the response
+    std::deque<InFlightRequest> requests; // forwarded and not answered yet, answered in this order
+    bool keepAlive = true;                // nobody asked to close it, so it can go back to the pool
+    std::chrono::steady_clock::time_point previousEnd; // last byte of the response before this one
+};
+
+// pipe used to move a segment body from the server socket to the browser socket with splice()
+class SplicePipe
+{
+public:
+    int readFd = -1;
+    int writeFd = -1;
+    int buffered = 0;              // bytes sitting in the pipe that the browser has not taken yet
+    bool waitingForClient = false; // write interest was turned on for the browser socket
+};
+
+
+// a browser request parked until another session's fetch of the same segment completes
+class ParkedRequest
+{
+public:
+    std::vector<char> request; // rewritten, ready to forward; later requests wait in the receive buffer
+    LogData log;
+    std::shared_ptr<AbrSession> session;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+// everything a worker keeps about one of its sockets, a browser or a server connection
+class Connection
+{
+public:
+    enum class Kind
+    {
+        Browser,
+        Upstream
+    };
+
+    Kind kind;
+    std::string ip;      // the browser's address, or the origin server's for an upstream connection
+    int peer = -1;       // the server connection a browser holds, or the browser holding it; -1 for none
+    ChainBuffer pending; // bytes the kernel did not accept yet, flushed once epoll reports the socket writable
+
+    // browser connections
+    uint64_t sessionId = 0;          // per worker, so a late cache delivery never reaches a reused socket number
+    std::string origin = "";         // server the nameserver picked for it, empty when the origins are given as addresses
+    bool resolving = false;          // its requests wait until the nameserver answered
+    std::vector<char> requestBuffer; // bytes not making up a complete request yet, or waiting behind a parked one
+    std::unique_ptr<ParkedRequest> parked;
+    bool closeAfterFlush = false; // its server already hung up, close once the queued bytes are out
+
+    // server connections
+    std::unique_ptr<ResponseState> response; // the response being streamed, allocated for server connections only
+    SplicePipe pipe;                         // created the first time a body is spliced
+    bool prefetch = false;                   // borrowed for prefetching, its responses go to the cache and no browser
+    bool connecting = false;                 // the handshake is still under way, requests queue in pending
+    std::chrono::steady_clock::time_point connectStarted;
+
+    Connection(Kind connectionKind, std::string address)
+        : kind(connectionKind), ip(std::move(address))
+    {
+        if (kind == Kind::Upstream)
+        {
+            response = std::make_unique<ResponseState>();
+        }
+    }
+};
+
+// The worker's connections indexed by socket number: finding the connection an event is for, or
+// its peer, is an array index instead of a tree walk or a scan over every pair.
+class ConnectionTable
+{
+private:
+    std::vector<std::unique_ptr<Connection>> slots;
+
+public:
+    Connection *find(int fd)
+    {
+        return fd >= 0 && (size_t)fd < slots.size() ? slots[fd].get() : nullptr;
+    }
+
+    Connection &open(int fd, Connection::Kind kind, std::string ip)
+    {
+        if ((size_t)fd >= slots.size())
+        {
+            slots.resize(std::max((size_t)fd + 1, slots.size() * 2));
+        }
+        slots[fd] = std::make_unique<Connection>(kind, std::move(ip));
+        return *slots[fd];
+    }
+
+    void erase(int fd)
+    {
+        if (find(fd) != nullptr)
+        {
+            slots[fd].reset();
+        }
+    }
+
+    // close every socket still open, on shutdown
+    void closeAll(void)
+    {
+        for (size_t fd = 0; fd < slots.size(); fd++)
+        {
+            if (slots[fd] != nullptr)
+            {
+                close(fd);
+                slots[fd].reset();
+            }
+        }
+    }
+};
+
 // Global Variables
 const int STATUS_ERROR = -1;
 const int MAX_BUFFER_SIZE = 2048;
-std::ofstream log_file;
+// stop reading from the server once this much is queued for a slow browser, resume below the low mark
+const size_t RELAY_HIGH_WATERMARK = 256 * 1024;
+const size_t RELAY_LOW_WATERMARK = 64 * 1024;
+// how much a single splice() call moves into the pipe
+const int SPLICE_CHUNK_SIZE = 1024 * 1024;
+// a request or response header larger than this is refused
+const size_t MAX_HEADER_SIZE = 64 * 1024;
+// queued chunks handed to one writev() when flushing
+const int FLUSH_IOVECS = 64;
+// longest a connection to an origin may take to be accepted before the next origin is tried; above the
+// kernel's 1 s SYN retransmit, so an origin whose accept queue overflowed in a burst is not taken for down
+const int CONNECT_TIMEOUT_MS = 1500;
+// the log file is shared by all workers, lines are queued to its writer thread
+ChunkLog chunkLog;
+
+// counters of every worker, merged when the admin listener is scraped (--metrics-port)
+MetricsRegistry metricsRegistry;
+
+// forward segment bodies with splice() instead of copying them through the proxy (--splice)
+bool spliceBodies = false;
 
-// client/upstream mapping
-std::map<int, int> clientToUpstreamMap;
+// take the origin connection's round trip time (TCP_INFO) out of chunk throughput (--tcp-info)
+bool sampleTcpInfo = false;
 
-// map used to keep track of what quality and bandwidth are associated with the upstream connection
-std::map<int, std::vector<ManifestArgs>> upstreamMap;
+// bitrate ladder of every video seen so far, shared by all sessions and workers
+ManifestCache manifestCache;
 
-// map that is used to track the throughput of the proxy-server connection
-std::map<int, double> upstreamThruMap;
+// throughput estimate and bitrate state of every viewer (browser IP + video)
+AbrSessionTable abrSessions;
 
-// map to keep track of client socket to its ip addr
-std::map<int, std::string> ClientToIpMap;
-std::map<int, std::string> ServerToIpMap;
+// bitrate selection rule (--abr), shared by all sessions and workers
+std::unique_ptr<AbrPolicy> abrPolicy;
 
-// map used to keep track of state for each browser connection by IP
-std::map<std::string, ClientState> StateMap;
+// origin servers requests are spread over when --upstream-server-host lists addresses; when it is a
+// name, the nameserver picks the server for each browser connection and the pool only takes over
+// while that one is down
+OriginPool *originPool = nullptr;
+std::string originName = "";
+int originPort = 0;
 
-LogData currLog;
+// segment cache shared by all workers (--cache-size), nullptr when caching is off
+SegmentCache *segmentCache = nullptr;
 
-// Send everything to prevent partial send, credit: Beej's Socket programming guide
-int sendDataComplete(int s, char *buf, int len)
+// how many segments to fetch ahead of each viewer into the segment cache (--prefetch), 0 = off
+int prefetchDepth = 0;
+// segment cache size in MB when prefetching without --cache-size
+const int DEFAULT_PREFETCH_CACHE_MB = 64;
+
+// Everything below is per worker: each worker thread owns its own sockets and session tables
+
+// every browser and server connection of this worker
+thread_local ConnectionTable connections;
+
+// this worker's inbox for segments fetched by sessions it is waiting on
+thread_local CacheMailbox *cacheMailbox = nullptr;
+
+// source of the browser connections' session ids
+thread_local uint64_t nextSessionId = 1;
+
+// warm keep-alive connections to the origin; a browser holds one only while it has requests outstanding
+thread_local UpstreamPool upstreamPool;
+
+// this worker's counters in metricsRegistry
+thread_local WorkerMetrics *metrics = nullptr;
+
+// this worker's nameserver client, nullptr when the origin is given as an address
+thread_local DnsResolver *resolver = nullptr;
+
+// browser connections waiting on the nameserver, by session id
+thread_local std::map<uint64_t, int> resolvingClients;
+
+// server connections whose handshake may still be under way, checked against CONNECT_TIMEOUT_MS;
+// a socket that was closed or connected since is skipped and dropped from the list
+thread_local std::vector<int> connectingUpstreams;
+
+// Send as much as the socket takes right now and queue the rest behind EPOLLOUT,
+// partial send handling credit: Beej's Socket programming guide
+int sendDataComplete(EventLoop &loop, int s, const char *buf, int len)
 {
-    int total = 0;       // how many bytes we've sent
-    int bytesleft = len; // how many we have left to send
-    int n;
+    Connection *conn = connections.find(s);
+    if (conn == nullptr)
+    {
+        return STATUS_ERROR;
+    }
+    ChainBuffer &pending = conn->pending;
+    int total = 0; // how many bytes we've sent
 
-    while (total < len)
+    // anything already queued has to go out first to keep the byte order, and nothing goes out
+    // before the connection is established
+    while (pending.empty() && !conn->connecting && total < len)
     {
-        n = send(s, buf + total, bytesleft, 0);
-        if (n == -1)
+        int n = send(s, buf + total, len - total, MSG_NOSIGNAL);
+        if (n == STATUS_ERROR)
         {
-            break;
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return STATUS_ERROR;
         }
         total += n;
-        bytesleft -= n;
     }
 
-    return total;
+    if (total < len)
+    {
+        if (pending.empty())
+        {
+            loop.setWriteInterest(s, true);
+        }
+        pending.append(buf + total, len - total);
+    }
+
+    return len;
+}
+
+// Same for a message made of several pieces, handed to the kernel with one writev() so nothing
+// has to be copied together first
+int sendDataComplete(EventLoop &loop, int s, std::initializer_list<std::string_view> pieces)
+{
+    Connection *conn = connections.find(s);
+    if (conn == nullptr)
+    {
+        return STATUS_ERROR;
+    }
+    ChainBuffer &pending = conn->pending;
+    size_t len = 0;
+    for (std::string_view piece : pieces)
+    {
+        len += piece.size();
+    }
+
+    size_t total = 0;
+    if (pending.empty() && !conn->connecting)
+    {
+        iovec iov[pieces.size()];
+        int count = 0;
+        for (std::string_view piece : pieces)
+        {
+            iov[count++] = {(void *)piece.data(), piece.size()};
+        }
+        ssize_t n;
+        do
+        {
+            n = writev(s, iov, count);
+        } while (n == STATUS_ERROR && errno == EINTR);
+        if (n == STATUS_ERROR && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            return STATUS_ERROR;
+        }
+        total = n == STATUS_ERROR ? 0 : n;
+    }
+
+    // queue whatever the kernel did not take, skipping the part that went out
+    if (total < len)
+    {
+        if (pending.empty())
+        {
+            loop.setWriteInterest(s, true);
+        }
+        for (std::string_view piece : pieces)
+        {
+            size_t skip = std::min(total, piece.size());
+            pending.append(piece.data() + skip, piece.size() - skip);
+            total -= skip;
+        }
+    }
+
+    return len;
 }
 
-void ClearState(const std::string &ipAddress)
+// write out queued bytes when the socket becomes writable, and drop write interest once empty
+void flushPending(EventLoop &loop, int s)
 {
-    StateMap[ipAddress].buf.clear();
-    StateMap[ipAddress].totalBytes = 0;
-    StateMap[ipAddress].contentLength = 0;
-    StateMap[ipAddress].gotHeader = false;
+    Connection *conn = connections.find(s);
+    if (conn == nullptr || conn->pending.empty())
+    {
+        return;
+    }
+
+    // the whole chain goes out with one writev() per batch of chunks, each sent chunk back to the pool
+    ChainBuffer &pending = conn->pending;
+    while (!pending.empty())
+    {
+        iovec iov[FLUSH_IOVECS];
+        int count = pending.iovecs(iov, FLUSH_IOVECS);
+        ssize_t n = writev(s, iov, count);
+        if (n == STATUS_ERROR)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        pending.consume(n);
+    }
+
+    if (pending.empty())
+    {
+        loop.setWriteInterest(s, false);
+    }
 }
 
-// Function to calculate the new throughput
-double calculateThru(double currThru, double adap_gain, double newThru)
+// unregister and close a socket, dropping everything kept about it including its queued bytes
+void closeSocket(EventLoop &loop, int s)
 {
-    return adap_gain * newThru + ((1 - adap_gain) * currThru);
+    loop.remove(s);
+    close(s);
+    connections.erase(s);
 }
 
-// gets the content length of the response
-void GetContentLength(std::string content, std::string &ipAddress)
+// a socket is live while it is a browser connection or an open server connection (held or pooled)
+bool isTracked(int s)
 {
-    std::stringstream ss(content);
-    std::string line;
-    std::string length = "0";
+    return connections.find(s) != nullptr;
+}
 
-    //  get the content length in the response
-    while (std::getline(ss, line))
+// close a server connection and forget everything kept about it
+void dropUpstream(EventLoop &loop, int upstreamSocket)
+{
+    Connection *upstream = connections.find(upstreamSocket);
+    if (upstream != nullptr)
     {
-        // find the line that contain the quailty info and bandwith associate with each quality
-        int pos = line.find("Content-Length:");
-        // int headerEndPos = line.find("\r\n\r\n");
-        // parse length if header has came through
-        if (pos != std::string::npos)
+        Connection *client = connections.find(upstream->peer);
+        if (client != nullptr)
         {
-            StateMap[ipAddress].gotHeader = true;
-            length = line.substr(pos + 15);
-            StateMap[ipAddress].contentLength = std::stoi(length);
-            return;
+            client->peer = -1;
+        }
+        // those fetches will never finish, let the sessions waiting on them fetch for themselves
+        for (const InFlightRequest &request : upstream->response->requests)
+        {
+            originPool->requestFailed(upstream->ip);
+            if (segmentCache != nullptr && !request.cacheKey.empty())
+            {
+                segmentCache->abandon(request.cacheKey);
+            }
+        }
+        if (upstream->pipe.readFd != -1)
+        {
+            close(upstream->pipe.readFd);
+            close(upstream->pipe.writeFd);
         }
     }
+    closeSocket(loop, upstreamSocket);
+}
+
+// tear down a browser connection, and the server connection it holds since its response is cut short
+void closeClient(EventLoop &loop, int clientSocket)
+{
+    Connection *client = connections.find(clientSocket);
+    if (client == nullptr || client->kind != Connection::Kind::Browser)
+    {
+        return;
+    }
+    metrics->browserConnections.add(-1);
+    if (client->peer != -1)
+    {
+        dropUpstream(loop, client->peer);
+    }
+    resolvingClients.erase(client->sessionId);
+    closeSocket(loop, clientSocket);
 }
 
 // replace the quality of the chunk in the url
@@ -165,132 +491,84 @@ std::string modifyURL(std::string &currURL, std::string newQuality)
     return currURL.replace(secondLastUnderscore + 1, lastUnderscore - secondLastUnderscore - 1, newQuality);
 }
 
-// replace the new url in the message that it should send
-void replaceURLInBuffer(char *buffer, size_t &bufferSize, const std::string &oldURL, const std::string &newURL)
+// name of the video a chunk or playlist belongs to, e.g. wing_it_240p_0037.ts, wing_it_240p.m3u8
+// and wing_it.m3u8 all give wing_it
+std::string videoNameOf(const std::string &fileName)
 {
-    // Find the position of the old URL in the buffer
-    char *urlPosition = strstr(buffer, oldURL.c_str());
-    if (urlPosition == nullptr)
-    {
-        return; // Return if old URL is not found in the buffer
-    }
-
-    // Calculate the positions and lengths
-    size_t oldURLLength = oldURL.length();
-    size_t newURLLength = newURL.length();
-    size_t position = urlPosition - buffer; // Get position of the old URL in the buffer
-
-    // Check if there's enough space in the buffer for the new URL
-    if (newURLLength > oldURLLength && (position + newURLLength >= bufferSize))
-    {
-        std::cerr << "Not enough space in the buffer to replace the old URL with the new URL." << std::endl;
-        return; // Handle error if the buffer can't accommodate the new URL
-    }
-
-    // If the new URL is shorter or equal in length to the old URL, we can replace it in place
-    if (newURLLength <= oldURLLength)
+    if (fileName.ends_with(".m3u8"))
     {
-        memcpy(buffer + position, newURL.c_str(), newURLLength);
-        if (newURLLength < oldURLLength)
+        // a variant playlist ends in _<quality>p
+        std::string name = fileName.substr(0, fileName.size() - 5);
+        size_t lastUnderscore = name.rfind('_');
+        if (lastUnderscore != std::string::npos && name.size() - lastUnderscore > 2 && name.back() == 'p' &&
+            std::all_of(name.begin() + lastUnderscore + 1, name.end() - 1, ::isdigit))
         {
-            // If the new URL is shorter, move the remaining part of the buffer to the left
-            memmove(buffer + position + newURLLength, buffer + position + oldURLLength, bufferSize - (position + oldURLLength));
+            return name.substr(0, lastUnderscore);
         }
+        return name;
     }
-    else
+    size_t lastUnderscore = fileName.rfind('_');
+    if (lastUnderscore == std::string::npos || lastUnderscore == 0)
     {
-        // If the new URL is longer, shift the buffer content to the right to make space
-        memmove(buffer + position + newURLLength, buffer + position + oldURLLength, bufferSize - (position + oldURLLength));
-        memcpy(buffer + position, newURL.c_str(), newURLLength);
+        return fileName;
     }
-
-    // Update buffer size accordingly
-    bufferSize = bufferSize - oldURLLength + newURLLength;
-
-    // Null-terminate the buffer
-    buffer[bufferSize] = '\0';
+    size_t secondLastUnderscore = fileName.rfind('_', lastUnderscore - 1);
+    if (secondLastUnderscore == std::string::npos)
+    {
+        return fileName;
+    }
+    return fileName.substr(0, secondLastUnderscore);
 }
 
-// function to help parse manifest file
-void parseManifest(std::string &content, int upstream_fd)
+// segment number of a chunk, e.g. wing_it_240p_0037.ts -> 37
+size_t segmentNumberOf(const std::string &chunkName)
 {
-    // parse content in the manifest file
-    std::stringstream ss(content);
-    std::string line;
-    int bandwidth = 0;
-    std::string qualityName = "";
-    int MinBw = INT16_MAX;
-    upstreamMap.erase(upstream_fd);
-
-    while (std::getline(ss, line))
+    size_t lastUnderscore = chunkName.rfind('_');
+    if (lastUnderscore == std::string::npos)
     {
-        // find the line that contain the quailty info and bandwith associate with each quality
-        if (line.rfind("#EXT-X-STREAM-INF", 0) == 0)
-        {
-            // parse what bandwidth, and name of quality
-            int BwPos = line.find("BANDWIDTH=");
-            int NamePos = line.find("NAME=");
-            if (BwPos != std::string::npos && NamePos != std::string::npos)
-            {
-                // parse the bandwidth
-                std::string bwStr = line.substr(BwPos + 10);
-                bandwidth = stof(bwStr) / 1000.0;
-
-                // parse the name of the quality
-                size_t nameStart = line.find("NAME=\"", NamePos) + 6;
-                size_t nameEnd = line.find('"', nameStart);
-                if (nameStart != std::string::npos && nameEnd != std::string::npos)
-                {
-                    qualityName = line.substr(nameStart, nameEnd - nameStart) + "p";
-                }
-
-                // add the bandwidth and quality name for the upstream socket
-                ManifestArgs currArg;
-                currArg.bandwidth = bandwidth;
-                currArg.qualityName = qualityName;
-                upstreamMap[upstream_fd].push_back(currArg);
-
-                // set first bitrate as the lowest when first parsing manifest
-                if (bandwidth < MinBw)
-                {
-                    MinBw = bandwidth;
-                }
-                // currLog.bitrate = MinBw;
-                currLog.LowestBitrate = MinBw;
-                currLog.avgThroughput = MinBw;
-            }
-        }
+        return 0;
     }
+    return strtoul(chunkName.c_str() + lastUnderscore + 1, nullptr, 10);
 }
 
-// Function to parse the Video chunk url in the Get request
-std::string ParseURL(std::string request)
+// the same chunk with another segment number, keeping the zero padding: (wing_it_240p_0037.ts, 38)
+// -> wing_it_240p_0038.ts
+std::string withSegmentNumber(const std::string &chunkName, size_t segment)
 {
-    // find the position where video chunk url is located
-    size_t getPos = request.find("GET ");
-    size_t urlStart = getPos + 5;
-    size_t urlEnd = request.find(" HTTP", urlStart);
-    std::string directoryUrl = request.substr(urlStart, urlEnd - urlStart);
-    size_t firstSlash = directoryUrl.find("/");
-    directoryUrl = directoryUrl.substr(firstSlash + 1, urlEnd - firstSlash);
-
-    if (getPos == std::string::npos || urlEnd == std::string::npos)
+    size_t lastUnderscore = chunkName.rfind('_');
+    size_t extension = chunkName.rfind('.');
+    if (lastUnderscore == std::string::npos || extension == std::string::npos || extension < lastUnderscore)
     {
-        return "";
+        return chunkName;
     }
-
-    // Extract the URL substring
-    return directoryUrl;
+    std::string number = std::to_string(segment);
+    size_t width = extension - lastUnderscore - 1;
+    if (number.size() < width)
+    {
+        number.insert(0, width - number.size(), '0');
+    }
+    return chunkName.substr(0, lastUnderscore + 1) + number + chunkName.substr(extension);
 }
 
-// check if this request is requesting a video chunk
-bool CheckChunkRequest(std::string request)
+// function to help parse manifest file, a video's master playlist is only parsed the first time
+// it goes by, after that every session shares the same ladder
+void parseManifest(const std::string &content, const std::string &videoName, const std::string &browserIp)
 {
-    if (request.find("GET") != std::string::npos && request.find(".ts") != std::string::npos)
+    std::shared_ptr<const BitrateLadder> ladder = manifestCache.get(videoName);
+    if (ladder == nullptr)
     {
-        return true;
+        ladder = BitrateLadder::parse(content);
+        if (ladder->empty())
+        {
+            return;
+        }
+        manifestCache.put(videoName, ladder);
     }
-    return false;
+
+    // fetching the master playlist means this viewer starts a new stream at the lowest bitrate
+    std::shared_ptr<AbrSession> session = abrSessions.get(browserIp, videoName);
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->restart(ladder);
 }
 
 bool isIPAddress(const std::string &input)
@@ -310,12 +588,17 @@ void parsingArgument(int argc, char *argv[], Argument &args)
             args.proxy_port = atoi(argv[++i]);
         else if (strcmp(argv[i], "--upstream-server-host") == 0)
         {
-            // Check if it's ip or host name
-            if (isIPAddress(argv[i + 1]))
-                args.upstream_host_ip = argv[++i];
-
+            // Check if it's ip (or a comma separated list of them) or host name
+            std::string hosts = argv[++i];
+            if (isIPAddress(hosts.substr(0, hosts.find(','))))
+            {
+                std::stringstream list(hosts);
+                std::string host;
+                while (std::getline(list, host, ','))
+                    args.upstream_host_ips.push_back(host);
+            }
             else
-                args.upstream_host_name = argv[++i];
+                args.upstream_host_name = hosts;
         }
         else if (strcmp(argv[i], "--upstream-server-port") == 0)
             args.upstream_port = atoi(argv[++i]);
@@ -329,11 +612,26 @@ void parsingArgument(int argc, char *argv[], Argument &args)
             args.nameserver_port = atoi(argv[++i]);
         else if (strcmp(argv[i], "--log-file-name") == 0)
             args.log_file_name = argv[++i];
+        else if (strcmp(argv[i], "--splice") == 0)
+            args.splice_bodies = true;
+        else if (strcmp(argv[i], "--tcp-info") == 0)
+            args.tcp_info = true;
+        else if (strcmp(argv[i], "--metrics-port") == 0)
+            args.metrics_port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--workers") == 0)
+            args.workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cache-size") == 0)
+            args.cache_size_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--abr") == 0)
+            args.abr = argv[++i];
+        else if (strcmp(argv[i], "--prefetch") == 0)
+            args.prefetch = atoi(argv[++i]);
     }
 }
 
-// Function to create the main socket and set it to non-blocking mode
-int CreateMainSocket(const std::string &host, int port)
+// Function to create the main socket and set it to non-blocking mode, with reusePort every
+// worker binds its own socket to the same address and the kernel spreads connections across them
+int CreateMainSocket(const std::string &host, int port, bool reusePort)
 {
     int mainSocket;
     struct sockaddr_in addr;
@@ -353,6 +651,11 @@ int CreateMainSocket(const std::string &host, int port)
         std::cerr << "setsockopt failed" << std::endl;
         exit(1);
     }
+    if (reusePort && setsockopt(mainSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        std::cerr << "setsockopt SO_REUSEPORT failed" << std::endl;
+        exit(1);
+    }
 
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
@@ -364,469 +667,1377 @@ int CreateMainSocket(const std::string &host, int port)
         exit(1);
     }
 
-    // Set the socket to listen with a maximum of 1 pending connections
-    if (listen(mainSocket, 10) < 0)
+    // Set the socket to listen, letting the kernel cap the backlog
+    if (listen(mainSocket, SOMAXCONN) < 0)
     {
         std::cout << "listen error" << std::endl;
         exit(1);
     }
 
+    // edge-triggered accept loop needs to stop on EAGAIN instead of blocking
+    fcntl(mainSocket, F_SETFL, O_NONBLOCK);
+
     // std::cout << "Created main " << mainSocket << "Listening on port " << port << std::endl;
     return mainSocket;
 }
 
-// Function to connect to the upstream server
+// Function to start connecting to the upstream server without waiting for the handshake: the socket
+// is returned right away and the event loop reports when it is writable (see finishConnect).
+// STATUS_ERROR when the connection failed on the spot, so the caller can try another origin.
 int ConnectUpstream(const std::string &host, int port)
 {
     int upstreamSocket;
     sockaddr_in server_addr;
 
-    // Create the upstream socket
-    upstreamSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (upstreamSocket < 0)
+    // host is already an address here (names are resolved by the nameserver without blocking),
+    // gethostbyname is not safe to call from several workers at once
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &server_addr.sin_addr) != 1)
     {
-        perror("Upstream socket");
-        exit(5);
+        std::cerr << "Bad upstream address " << host << std::endl;
+        return STATUS_ERROR;
     }
 
-    struct hostent *host_addr = gethostbyname(host.c_str());
-    if (!host_addr)
+    // Create the upstream socket, non-blocking from the start so the connect cannot hang the worker
+    upstreamSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (upstreamSocket < 0)
     {
-        std::cout << "host error connet upstream" << std::endl;
-        exit(6);
+        perror("Upstream socket");
+        return STATUS_ERROR;
     }
 
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-
-    inet_pton(AF_INET, host.c_str(), &server_addr.sin_addr);
-    // try to connect upstrea
+    // try to connect upstream; the handshake usually completes later, in the event loop
     int result = connect(upstreamSocket, (struct sockaddr *)&server_addr, sizeof(server_addr));
     if (result == STATUS_ERROR && errno != EINPROGRESS)
     {
-        std::string errorString = "Connection error to upstream server " + host + " on port " + std::to_string(port) + "\n";
+        std::string errorString = "Connection error to upstream server " + host + " on port " + std::to_string(port);
         perror(errorString.c_str());
         close(upstreamSocket);
         return STATUS_ERROR;
     }
 
-    // add the server and its ip to the map
+    // add the server and its ip to the connection table
     char serverIp[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &server_addr.sin_addr, serverIp, INET_ADDRSTRLEN);
-    std::string clientIPStr(serverIp);
-    ServerToIpMap[upstreamSocket] = serverIp;
+    // even a connection established on the spot is reported writable, and finished, by the event loop
+    Connection &upstream = connections.open(upstreamSocket, Connection::Kind::Upstream, serverIp);
+    upstream.connecting = true;
+    upstream.connectStarted = std::chrono::steady_clock::now();
 
     return upstreamSocket;
 }
 
-// handle new connections
-int createConnection(int mainSocket, fd_set &mainSet, const Argument &args)
+// a browser's lookup came back: the first address is its origin, the others stand by in the pool
+void useOrigins(Connection &client, const std::vector<std::string> &addresses)
+{
+    client.origin = addresses.front();
+    for (const std::string &address : addresses)
+    {
+        originPool->add(address);
+    }
+}
+
+// handle new connections, returns the client socket or STATUS_ERROR once the accept queue is empty
+int createConnection(int mainSocket, EventLoop &loop)
 {
     // std::cout << "Entering createConnection()" << std::endl;
     struct sockaddr_in client_addr;
     socklen_t client_len = sizeof(client_addr);
 
-    int clientSocket = accept(mainSocket, (struct sockaddr *)&client_addr, &client_len);
+    int clientSocket = accept4(mainSocket, (struct sockaddr *)&client_addr, &client_len, SOCK_NONBLOCK);
     if (clientSocket == STATUS_ERROR)
     {
-        perror("Accept Error!");
-        exit(4);
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            perror("Accept Error!");
+        }
+        return STATUS_ERROR;
     }
 
     char clientIP[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &client_addr.sin_addr, clientIP, INET_ADDRSTRLEN);
     std::string clientIPStr(clientIP);
 
-    // Create and connect an upstream socket for this client
-    int upstreamSocket = ConnectUpstream(args.upstream_host_ip, args.upstream_port);
-
-    if (upstreamSocket == STATUS_ERROR || upstreamSocket == 0)
-    {
-        close(clientSocket);
-        close(upstreamSocket);
-        FD_CLR(clientSocket, &mainSet);
-        exit(7);
-    }
-
-    FD_SET(clientSocket, &mainSet);
-    FD_SET(upstreamSocket, &mainSet);
-    // std::cout << "Added client and upstream socket to main set\n";
-
-    clientToUpstreamMap[clientSocket] = upstreamSocket;
-    ClientToIpMap[clientSocket] = clientIPStr;
-    if (StateMap.find(clientIPStr) == StateMap.end())
+    // the server connection is only picked once the browser sends a request
+    loop.add(clientSocket);
+    Connection &client = connections.open(clientSocket, Connection::Kind::Browser, clientIPStr);
+    metrics->browserConnections.add(1);
+    client.sessionId = nextSessionId++;
+    if (resolver != nullptr)
     {
-        ClientState currState;
-        StateMap[clientIPStr] = currState;
-        StateMap[clientIPStr].clientSockets.push_back(clientSocket);
-    }
-    else
-    {
-        StateMap[clientIPStr].clientSockets.push_back(clientSocket);
+        // each browser connection asks the nameserver, so its balancing decisions take effect
+        std::vector<std::string> addresses = resolver->resolve(originName, client.sessionId);
+        if (addresses.empty())
+        {
+            client.resolving = true;
+            resolvingClients[client.sessionId] = clientSocket;
+        }
+        else
+        {
+            useOrigins(client, addresses);
+        }
     }
 
-    upstreamMap.erase(upstreamSocket);
-
-    return std::max(clientSocket, upstreamSocket);
+    return clientSocket;
 }
 
-// Function to handle communication
-void processConnection(int socket, fd_set &mainSet, double alpha, double multiplier)
+// key of an origin server in the connection pools
+std::string originKeyOf(const std::string &address)
 {
-    char buffer[MAX_BUFFER_SIZE];
-    fcntl(socket, F_SETFL, O_NONBLOCK);
-
-    int numReceivedBytes = recv(socket, buffer, sizeof(buffer), 0);
+    return address + ":" + std::to_string(originPort);
+}
 
-    // nothing is communication, need to close connection
-    if (numReceivedBytes == 0)
+// A warm connection to the origin the pool picks, otherwise a new one that may still be connecting;
+// an origin that fails the connection on the spot is marked down and the next one is tried.
+// STATUS_ERROR once no origin is left.
+int borrowUpstream(EventLoop &loop, const std::string &preferred)
+{
+    std::string origin;
+    while (!(origin = originPool->select(preferred)).empty())
     {
-        // this is a client socket, close corresponding server connection and clear out data
-        if (clientToUpstreamMap.find(socket) != clientToUpstreamMap.end())
-        {
-            std::string ip = ClientToIpMap[socket];
-            int upstreamSocket = clientToUpstreamMap[socket];
-            close(upstreamSocket);
-            FD_CLR(upstreamSocket, &mainSet);
-            clientToUpstreamMap.erase(socket);
-            ClientToIpMap.erase(socket);
-            ServerToIpMap.erase(upstreamSocket);
-            upstreamMap.erase(upstreamSocket);
-            for (auto it = StateMap[ip].clientSockets.begin(); it != StateMap[ip].clientSockets.end(); ++it)
-            {
-                if (*it == socket)
-                {
-                    StateMap[ip].clientSockets.erase(it);
-                    break;
-                }
-            }
-        }
-        // upstream socket
-        else
+        int upstreamSocket;
+        while ((upstreamSocket = upstreamPool.borrow(originKeyOf(origin))) != STATUS_ERROR)
         {
-            int clientSocket = -1;
-            // close the corresponding client socket
-            for (auto pair : clientToUpstreamMap)
+            // the server may have closed it while idle before the event loop noticed
+            char probe;
+            if (recv(upstreamSocket, &probe, 1, MSG_PEEK | MSG_DONTWAIT) == STATUS_ERROR && (errno == EAGAIN || errno == EWOULDBLOCK))
             {
-                if (pair.second == socket)
-                {
-                    clientSocket = pair.first;
-                    close(pair.first);
-                    FD_CLR(clientSocket, &mainSet);
-                    break;
-                }
+                return upstreamSocket;
             }
+            dropUpstream(loop, upstreamSocket);
+        }
 
-            // clear out the connection in data structure
-            std::string ip = ClientToIpMap[clientSocket];
-            for (auto it = StateMap[ip].clientSockets.begin(); it != StateMap[ip].clientSockets.end(); ++it)
-            {
-                if (*it == clientSocket)
-                {
-                    StateMap[ip].clientSockets.erase(it);
-                    break;
-                }
-            }
-            clientToUpstreamMap.erase(clientSocket);
-            ClientToIpMap.erase(clientSocket);
-            ServerToIpMap.erase(socket);
-            upstreamMap.erase(socket);
+        upstreamSocket = ConnectUpstream(origin, originPort);
+        if (upstreamSocket != STATUS_ERROR)
+        {
+            // writable once the handshake is through, or failed
+            loop.add(upstreamSocket, EventLoop::BASE_EVENTS | EPOLLOUT);
+            connectingUpstreams.push_back(upstreamSocket);
+            return upstreamSocket;
         }
+        originPool->markDown(origin);
+    }
+    return STATUS_ERROR;
+}
 
-        close(socket);
-        FD_CLR(socket, &mainSet);
-        return;
+// Connection to the origin for a browser's next request: the one it already holds while responses
+// are outstanding, otherwise a borrowed one; STATUS_ERROR when every origin is down
+int acquireUpstream(EventLoop &loop, int clientSocket)
+{
+    Connection *client = connections.find(clientSocket);
+    if (client->peer != -1)
+    {
+        return client->peer;
     }
-    else if (numReceivedBytes == STATUS_ERROR)
+
+    int upstreamSocket = borrowUpstream(loop, client->origin);
+    if (upstreamSocket == STATUS_ERROR)
     {
-        // Ignore possible linux error
-        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return STATUS_ERROR;
+    }
+    client->peer = upstreamSocket;
+    connections.find(upstreamSocket)->peer = clientSocket;
+    return upstreamSocket;
+}
+
+// The browser's last outstanding response is through: its server connection goes back to the pool,
+// or is closed when either side asked for that or the pool is full
+void releaseUpstream(EventLoop &loop, int clientSocket, int upstreamSocket)
+{
+    Connection *client = connections.find(clientSocket);
+    if (client != nullptr)
+    {
+        client->peer = -1;
+    }
+    Connection *upstream = connections.find(upstreamSocket);
+    upstream->peer = -1;
+    upstream->prefetch = false;
+
+    ResponseState &state = *upstream->response;
+    state.paused = false;
+    if (!state.keepAlive || !upstreamPool.giveBack(originKeyOf(upstream->ip), upstreamSocket))
+    {
+        dropUpstream(loop, upstreamSocket);
+    }
+}
+
+// Fetch the segments after the one a viewer was just served into the segment cache, at the bitrate
+// the ABR policy would pick right now, so the browser's next requests are answered from memory.
+// The requests are pipelined on one borrowed connection that no browser holds, to the viewer's
+// origin or the one the pool picks (--prefetch).
+void prefetchAfter(EventLoop &loop, const std::string &origin, const std::shared_ptr<AbrSession> &session,
+                   const std::string &chunkName)
+{
+    std::vector<std::string> names;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        // the variant playlist tells where the video ends
+        if (session->ladder == nullptr || session->timeline == nullptr)
         {
             return;
         }
+        size_t segment = segmentNumberOf(chunkName);
+        size_t rung = abrPolicy->peek(*session, segment + 1);
+        path = session->chunkPath;
+        for (size_t next = segment + 1; next <= segment + prefetchDepth && next < session->timeline->durations.size(); next++)
+        {
+            std::string name = withSegmentNumber(chunkName, next);
+            names.push_back(modifyURL(name, session->ladder->qualityNames[rung]));
+        }
     }
 
-    // Handle received bytes
-    // Check if data is from client or upstream and forward appropriately
-    std::string buffer_str = buffer;
-    if (clientToUpstreamMap.find(socket) != clientToUpstreamMap.end())
+    int upstreamSocket = STATUS_ERROR;
+    for (const std::string &name : names)
     {
-        // Data received from client, send it to upstream server
-        int upstreamSocket = clientToUpstreamMap[socket];
-        int dataLen = numReceivedBytes;
-        int bytesSent = 0;
-        // parse necessary information out of the buffer for a video chunk request
-        if (CheckChunkRequest(buffer))
+        // skip what is cached or on its way already
+        if (!segmentCache->reserve(name))
         {
-            currLog.chunkRequest = true;
-            currLog.chunkName = ParseURL(buffer);
+            continue;
         }
-        if (currLog.chunkRequest)
+        if (upstreamSocket == STATUS_ERROR)
         {
-            std::string qualityName = "";
-            for (auto args : upstreamMap[upstreamSocket])
+            upstreamSocket = borrowUpstream(loop, origin);
+            if (upstreamSocket == STATUS_ERROR)
             {
-                if (currLog.avgThroughput >= (args.bandwidth * multiplier))
-                {
-                    if (args.bandwidth > currLog.bitrate)
-                    {
-                        qualityName = args.qualityName;
-                        currLog.bitrate = args.bandwidth;
-                        size_t bufferSize = strlen(buffer);
-                        std::string newUrl = modifyURL(currLog.chunkName, qualityName);
-                        currLog.chunkName = newUrl;
-                        replaceURLInBuffer(buffer, bufferSize, currLog.chunkName, newUrl);
-                    }
-                }
+                segmentCache->abandon(name);
+                return;
             }
+            connections.find(upstreamSocket)->prefetch = true;
         }
-        // keep sending request until it has all been sent to the server
-        while (bytesSent < dataLen)
+
+        InFlightRequest inFlight;
+        inFlight.prefetch = true;
+        inFlight.session = session;
+        inFlight.requestName = name;
+        inFlight.cacheKey = name;
+        inFlight.sentAt = std::chrono::steady_clock::now();
+        Connection *upstream = connections.find(upstreamSocket);
+        upstream->response->requests.push_back(std::move(inFlight));
+        originPool->requestSent(upstream->ip);
+
+        std::string request = "GET " + path + name + " HTTP/1.1\r\nHost: " + originKeyOf(upstream->ip) + "\r\n\r\n";
+        sendDataComplete(loop, upstreamSocket, request.data(), request.size());
+    }
+}
+
+// append one chunk line to the log file shared by all workers
+void writeLogLine(const LogData &entry)
+{
+    // every chunk served is logged, whether fetched or cached, so it is counted here too
+    metrics->chunkSeconds.observe(entry.duration);
+    metrics->countBitrate(entry.videoName, entry.bitrate);
+
+    chunkLog.write(entry.browserIp, entry.chunkName, entry.serverIp, entry.duration, entry.throughput,
+                   entry.avgThroughput, entry.bitrate);
+}
+
+// Finish off a fully relayed response: update the throughput estimate and log chunk downloads.
+// Returns false once the browser no longer holds the server connection, i.e. this was its last
+// outstanding response and the connection went back to the pool (or was closed).
+bool completeResponse(EventLoop &loop, ResponseState &state, int upstreamSocket, int clientSocket, double alpha)
+{
+    InFlightRequest &request = state.requests.front();
+    if (state.isManifest && state.manifest.find("BANDWIDTH") != std::string::npos)
+    {
+        parseManifest(state.manifest, videoNameOf(request.requestName), request.log.browserIp);
+    }
+    else if (state.isManifest && state.manifest.find("#EXTINF") != std::string::npos)
+    {
+        // variant playlist: its segment durations drive the buffer estimate
+        std::string videoName = videoNameOf(request.requestName);
+        if (manifestCache.getTimeline(videoName) == nullptr)
         {
-            bytesSent += sendDataComplete(upstreamSocket, buffer + bytesSent, dataLen - bytesSent);
-            if (bytesSent == STATUS_ERROR)
-            {
-                std::cout << "Data send error!\n";
-                return;
-            }
+            manifestCache.putTimeline(videoName, SegmentTimeline::parse(state.manifest));
         }
     }
+
+    state.timing.lastByte = std::chrono::steady_clock::now();
+    state.timing.bytes = state.totalBytes;
+    if (sampleTcpInfo && request.log.chunkRequest)
+    {
+        state.timing.sampleKernel(upstreamSocket);
+    }
+    // the time to first byte steers which origin later connections go to
+    originPool->responseReceived(connections.find(upstreamSocket)->ip, state.timing.waitSeconds());
+
+    // a prefetched segment still tells how fast the server delivers
+    if (request.prefetch && request.session != nullptr && state.head.status == 200)
+    {
+        std::lock_guard<std::mutex> lock(request.session->mutex);
+        request.session->recordThroughput(state.timing, alpha);
+    }
+
+    // only chunk downloads feed the viewer's estimate, timed from the request to the last byte
+    if (request.log.chunkRequest && request.session != nullptr)
+    {
+        AbrSession &session = *request.session;
+        std::lock_guard<std::mutex> lock(session.mutex);
+        session.recordChunk(state.timing, alpha);
+
+        // print the log message to the log file for a chunk response
+        request.log.duration = session.lastDuration;
+        request.log.throughput = session.lastThroughput;
+        request.log.avgThroughput = session.avgThroughput;
+        writeLogLine(request.log);
+    }
+
+    // publish the segment to the cache, only complete 200 responses are worth keeping
+    if (!request.cacheKey.empty())
+    {
+        if (state.head.status == 200 && (int)state.cacheBuffer.size() == state.totalBytes)
+        {
+            segmentCache->fill(request.cacheKey, std::move(state.cacheBuffer));
+        }
+        else
+        {
+            segmentCache->abandon(request.cacheKey);
+        }
+    }
+
+    // the viewer got a chunk, the next ones can be fetched ahead
+    std::shared_ptr<AbrSession> prefetchFor;
+    std::string servedChunk;
+    if (prefetchDepth > 0 && request.log.chunkRequest && state.head.status == 200)
+    {
+        prefetchFor = request.session;
+        servedChunk = request.log.chunkName;
+    }
+
+    // get ready for the next response on this connection
+    ResponseState next;
+    next.paused = state.paused;
+    next.requests = std::move(state.requests);
+    next.requests.pop_front();
+    next.keepAlive = state.keepAlive && state.head.keepAlive;
+    next.previousEnd = state.timing.lastByte;
+    state = std::move(next);
+
+    bool held = true;
+    if (state.requests.empty())
+    {
+        releaseUpstream(loop, clientSocket, upstreamSocket);
+        held = false;
+    }
+    Connection *client = connections.find(clientSocket);
+    if (prefetchFor != nullptr && client != nullptr)
+    {
+        prefetchAfter(loop, client->origin, prefetchFor, servedChunk);
+    }
+    return held;
+}
+
+// Stream bytes from the server straight to the browser, tracking where each response ends
+// a broken response ends the browser connection it was for, or only the prefetch connection
+void abortRelay(EventLoop &loop, int upstreamSocket, int clientSocket)
+{
+    if (clientSocket == STATUS_ERROR)
+    {
+        dropUpstream(loop, upstreamSocket);
+    }
     else
     {
-        // Data received from upstream server, find corresponding client and send it
-        for (const auto &pair : clientToUpstreamMap)
+        closeClient(loop, clientSocket);
+    }
+}
+
+// Parse and forward what the server sent. clientSocket is STATUS_ERROR on a prefetch connection.
+void relayResponseData(EventLoop &loop, int upstreamSocket, int clientSocket, const char *data, int len, double alpha)
+{
+    ResponseState &state = *connections.find(upstreamSocket)->response;
+    int offset = 0;
+
+    while (offset < len)
+    {
+        int consumed = len - offset;
+        if (!state.gotHeader)
         {
-            if (pair.second == socket)
+            // a pipelined response cannot start before the one ahead of it ended
+            if (state.header.empty() && !state.requests.empty())
             {
-                std::string ipAddress = ClientToIpMap[pair.first];
-                currLog.serverIp = ServerToIpMap[pair.second];
-                currLog.browserIp = ipAddress;
+                state.timing.firstByte = std::chrono::steady_clock::now();
+                state.timing.requestSent = std::max(state.requests.front().sentAt, state.previousEnd);
+            }
 
-                if (strstr(buffer, "#EXTM3U") && strstr(buffer, "BANDWIDTH"))
-                {
-                    parseManifest(buffer_str, pair.second);
-                }
+            // the header is collected until the blank line, it decides how the body is framed
+            size_t before = state.header.size();
+            state.header.append(data + offset, consumed);
+            size_t headerEnd = findHeaderEnd(state.header, before);
+            if (headerEnd != 0)
+            {
+                state.header.resize(headerEnd);
+                consumed = headerEnd - before;
+                state.gotHeader = true;
+            }
+            else if (state.header.size() > MAX_HEADER_SIZE)
+            {
+                abortRelay(loop, upstreamSocket, clientSocket);
+                return;
+            }
 
-                // only need to parse content len if we have not got the header
-                currLog.startTime = std::chrono::steady_clock::now();
-                if (strstr(buffer, "\r\n\r\n") != nullptr && !StateMap[ipAddress].gotHeader)
+            // a response nobody asked for, or one that cannot be framed, leaves the connection unusable
+            if (state.gotHeader && (state.requests.empty() ||
+                                    parseResponseHead(state.header, state.requests.front().headRequest, state.head) != ParseResult::Complete))
+            {
+                abortRelay(loop, upstreamSocket, clientSocket);
+                return;
+            }
+            if (state.gotHeader)
+            {
+                state.body.start(state.head.bodyMode, state.head.contentLength);
+                // a segment of known length is collected for the cache without regrowing
+                size_t expected = state.header.size() + state.head.contentLength;
+                if (!state.requests.front().cacheKey.empty() && state.head.bodyMode == BodyFramer::Mode::Length &&
+                    expected <= segmentCache->maxEntrySize())
                 {
-                    GetContentLength(buffer, ipAddress);
-                    StateMap[ipAddress].contentLength += strstr(buffer, "\r\n\r\n") - buffer + 4;
+                    state.cacheBuffer.reserve(expected);
                 }
-                StateMap[ipAddress].totalBytes += numReceivedBytes;
-                StateMap[ipAddress].buf.insert(StateMap[ipAddress].buf.end(), buffer, buffer + numReceivedBytes);
+                // playlists are the only bodies the proxy needs to look into
+                state.isManifest = state.head.status == 200 && state.requests.front().requestName.ends_with(".m3u8");
+            }
+        }
+        else
+        {
+            consumed = state.body.consume(data + offset, consumed, state.isManifest ? &state.manifest : nullptr);
+            if (state.body.failed())
+            {
+                abortRelay(loop, upstreamSocket, clientSocket);
+                return;
+            }
+        }
 
-                // keep recvieve data until content length and storing it in the State
-                while (StateMap[ipAddress].totalBytes < StateMap[ipAddress].contentLength)
-                {
-                    numReceivedBytes = recv(socket, buffer, sizeof(buffer), 0);
-                    buffer_str = buffer;
-                    if (strstr(buffer, "#EXTM3U") && strstr(buffer, "BANDWIDTH"))
-                    {
-                        parseManifest(buffer_str, pair.second);
-                    }
-                    if (numReceivedBytes < 0)
-                    {
-                        continue;
-                    }
+        // forward right away instead of holding the whole segment in memory; prefetched segments only
+        // go into the cache
+        if (clientSocket != STATUS_ERROR)
+        {
+            sendDataComplete(loop, clientSocket, data + offset, consumed);
+            metrics->bytesToBrowsers.add(consumed);
+        }
+        state.totalBytes += consumed;
 
-                    StateMap[ipAddress].totalBytes += numReceivedBytes;
-                    StateMap[ipAddress].buf.insert(StateMap[ipAddress].buf.end(), buffer, buffer + numReceivedBytes);
-                }
+        std::string &cacheKey = state.requests.front().cacheKey;
+        if (!cacheKey.empty())
+        {
+            state.cacheBuffer.insert(state.cacheBuffer.end(), data + offset, data + offset + consumed);
+            if (state.cacheBuffer.size() > segmentCache->maxEntrySize())
+            {
+                segmentCache->abandon(cacheKey);
+                cacheKey = "";
+                std::vector<char>().swap(state.cacheBuffer);
+            }
+        }
+        offset += consumed;
 
-                currLog.endTime = std::chrono::steady_clock::now();
-                auto durationMs = std::chrono::duration_cast<std::chrono::milliseconds>(currLog.endTime - currLog.startTime).count();
-                // currLog.duration = std::max(durationMs / 1000.0, 0.01); // minimum duration to prevent divide by 0 later
-                currLog.duration = durationMs / 1000.0;
-                if (currLog.duration == 0)
-                {
-                    currLog.duration = 0.01;
-                }
-                double currThru = StateMap[ipAddress].totalBytes * 8.0 / currLog.duration / 1000.0;
+        if (!state.gotHeader)
+        {
+            continue;
+        }
+        if (state.head.status < 200)
+        {
+            // interim response (100 Continue), the real one follows for the same request
+            state.header.clear();
+            state.gotHeader = false;
+            state.totalBytes = 0;
+            state.cacheBuffer.clear();
+            continue;
+        }
+        if (state.body.done())
+        {
+            // nothing may follow the last outstanding response
+            if (!completeResponse(loop, state, upstreamSocket, clientSocket, alpha))
+            {
+                return;
+            }
+        }
+    }
+
+    // hand the rest of a segment body over to splice once the bytes already read are forwarded,
+    // unless the body is also going into the cache
+    if (spliceBodies && clientSocket != STATUS_ERROR && state.gotHeader && state.body.mode() == BodyFramer::Mode::Length && !state.body.done() &&
+        state.requests.front().log.chunkRequest && state.requests.front().cacheKey.empty())
+    {
+        state.splicing = true;
+    }
+}
+
+// the server hung up: close its browser connection too, once everything queued for it is out
+void closeUpstream(EventLoop &loop, int upstreamSocket)
+{
+    // an idle pooled connection timing out concerns no browser
+    if (upstreamPool.forget(upstreamSocket))
+    {
+        dropUpstream(loop, upstreamSocket);
+        return;
+    }
 
-                currLog.avgThroughput = calculateThru(currLog.avgThroughput, alpha, currThru);
-                currLog.throughput = currThru;
+    Connection *client = connections.find(connections.find(upstreamSocket)->peer);
+    if (client == nullptr)
+    {
+        dropUpstream(loop, upstreamSocket);
+        return;
+    }
+
+    // let the browser receive what is still queued for it before closing
+    if (!client->pending.empty())
+    {
+        loop.remove(upstreamSocket);
+        client->closeAfterFlush = true;
+    }
+    else
+    {
+        closeClient(loop, connections.find(upstreamSocket)->peer);
+    }
+}
+
+// Move the rest of a segment body from the server to the browser through a pipe, the bytes never
+// enter user space. Returns false once either side would block or the connection was closed.
+bool spliceResponseBody(EventLoop &loop, int upstreamSocket, int clientSocket, double alpha)
+{
+    Connection *upstream = connections.find(upstreamSocket);
+    ResponseState &state = *upstream->response;
+    SplicePipe &pipe = upstream->pipe;
+
+    if (pipe.readFd == STATUS_ERROR)
+    {
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == STATUS_ERROR)
+        {
+            perror("pipe2");
+            closeUpstream(loop, upstreamSocket);
+            return false;
+        }
+        pipe.readFd = fds[0];
+        pipe.writeFd = fds[1];
+        // a larger pipe means fewer round trips per segment, the default size is fine if this fails
+        fcntl(pipe.writeFd, F_SETPIPE_SZ, SPLICE_CHUNK_SIZE);
+    }
 
-                // send completed response to the client, and reset state
-                if (StateMap[ipAddress].totalBytes >= StateMap[ipAddress].contentLength && StateMap[ipAddress].contentLength > 0)
+    // the header (and any body bytes read with it) must reach the browser before the spliced part
+    if (!connections.find(clientSocket)->pending.empty())
+    {
+        state.paused = true;
+        return false;
+    }
+
+    while (true)
+    {
+        // empty the pipe into the browser first
+        while (pipe.buffered > 0)
+        {
+            ssize_t n = splice(pipe.readFd, nullptr, clientSocket, nullptr, pipe.buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n == STATUS_ERROR)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
                 {
-                    int bytesSent = 0;
-                    while (bytesSent < StateMap[ipAddress].contentLength)
+                    // browser is full, wait for it to become writable before reading more
+                    if (!pipe.waitingForClient)
                     {
-                        int sendDataLen = StateMap[ipAddress].buf.size();
-                        bytesSent += sendDataComplete(StateMap[ipAddress].clientSockets[0], &StateMap[ipAddress].buf[bytesSent], sendDataLen - bytesSent);
-                        if (bytesSent < 0)
-                        {
-                            ClearState(ipAddress);
-                            break;
-                        }
+                        loop.setWriteInterest(clientSocket, true);
+                        pipe.waitingForClient = true;
                     }
-                    ClearState(ipAddress);
+                    state.paused = true;
+                    return false;
                 }
+                closeClient(loop, clientSocket);
+                return false;
+            }
+            pipe.buffered -= n;
+            state.totalBytes += n;
+            metrics->bytesToBrowsers.add(n);
+        }
 
-                // print the log message to the log file for a chunk response
-                if (currLog.chunkRequest)
-                {
-                    log_file << currLog.browserIp << " " << currLog.chunkName << " " << currLog.serverIp << " "
-                             << currLog.duration << " " << currLog.throughput << " " << currLog.avgThroughput << " "
-                             << currLog.bitrate << std::endl;
-                    currLog.chunkRequest = false;
-                }
-                currLog.bitrate = currLog.LowestBitrate;
+        if (pipe.waitingForClient)
+        {
+            loop.setWriteInterest(clientSocket, false);
+            pipe.waitingForClient = false;
+        }
+
+        if (state.body.done())
+        {
+            completeResponse(loop, state, upstreamSocket, clientSocket, alpha);
+            // anything after the body belongs to the next response and goes through recv() again
+            return isTracked(upstreamSocket);
+        }
+
+        int wanted = std::min(state.body.remaining(), (size_t)SPLICE_CHUNK_SIZE);
+        ssize_t n = splice(upstreamSocket, nullptr, pipe.writeFd, nullptr, wanted, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n == 0)
+        {
+            closeUpstream(loop, upstreamSocket);
+            return false;
+        }
+        if (n == STATUS_ERROR)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+            closeUpstream(loop, upstreamSocket);
+            return false;
+        }
+        pipe.buffered += n;
+        state.body.advance(n);
+    }
+}
+
+// answer 502 and close the browser connection once that went out
+void refuseRequest(EventLoop &loop, int clientSocket)
+{
+    static const char BAD_GATEWAY[] = "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    Connection *client = connections.find(clientSocket);
+    if (sendDataComplete(loop, clientSocket, BAD_GATEWAY, sizeof(BAD_GATEWAY) - 1) == STATUS_ERROR || client->pending.empty())
+    {
+        closeClient(loop, clientSocket);
+        return;
+    }
+    client->closeAfterFlush = true;
+}
+
+// Send a request to the server over the connection the browser holds (borrowed from the pool if it
+// holds none); its response is expected after those of the requests already on that connection
+void forwardRequest(EventLoop &loop, int clientSocket, InFlightRequest inFlight, bool keepAlive,
+                    std::initializer_list<std::string_view> pieces)
+{
+    int upstreamSocket = acquireUpstream(loop, clientSocket);
+    if (upstreamSocket == STATUS_ERROR)
+    {
+        // no origin to send it to, the browser gets an error instead of a hanging request
+        if (!inFlight.cacheKey.empty())
+        {
+            segmentCache->abandon(inFlight.cacheKey);
+        }
+        refuseRequest(loop, clientSocket);
+        return;
+    }
+    Connection *upstream = connections.find(upstreamSocket);
+    ResponseState &response = *upstream->response;
+    inFlight.log.serverIp = upstream->ip;
+    inFlight.sentAt = std::chrono::steady_clock::now();
+    response.requests.push_back(std::move(inFlight));
+    originPool->requestSent(upstream->ip);
+    if (!keepAlive)
+    {
+        response.keepAlive = false;
+    }
+
+    // whatever does not fit now is sent on EPOLLOUT
+    if (sendDataComplete(loop, upstreamSocket, pieces) == STATUS_ERROR)
+    {
+        std::cout << "Data send error!\n";
+    }
+}
+
+// An origin did not accept a connection: mark it down and move the requests queued on the connection
+// to one with the next origin, or refuse them when no origin is left
+void connectFailed(EventLoop &loop, int upstreamSocket, int error)
+{
+    Connection *upstream = connections.find(upstreamSocket);
+    std::string origin = upstream->ip;
+    std::cerr << "Connection error to upstream server " << origin << " on port " << originPort << ": "
+              << strerror(error) << std::endl;
+    originPool->markDown(origin);
+
+    // nothing was sent yet, so the queued bytes are exactly the requests
+    std::deque<InFlightRequest> requests = std::move(upstream->response->requests);
+    upstream->response->requests.clear();
+    ChainBuffer queued = std::move(upstream->pending);
+    bool prefetch = upstream->prefetch;
+    bool keepAlive = upstream->response->keepAlive;
+    int clientSocket = upstream->peer;
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        originPool->requestFailed(origin);
+    }
+    dropUpstream(loop, upstreamSocket);
+
+    Connection *client = connections.find(clientSocket);
+    int replacementSocket = borrowUpstream(loop, client == nullptr ? "" : client->origin);
+    if (replacementSocket == STATUS_ERROR)
+    {
+        for (const InFlightRequest &request : requests)
+        {
+            if (!request.cacheKey.empty())
+            {
+                segmentCache->abandon(request.cacheKey);
             }
         }
+        if (client != nullptr)
+        {
+            refuseRequest(loop, clientSocket);
+        }
+        return;
+    }
+
+    Connection *replacement = connections.find(replacementSocket);
+    replacement->peer = clientSocket;
+    replacement->prefetch = prefetch;
+    if (client != nullptr)
+    {
+        client->peer = replacementSocket;
+    }
+    ResponseState &response = *replacement->response;
+    response.keepAlive = keepAlive;
+    for (InFlightRequest &request : requests)
+    {
+        request.log.serverIp = replacement->ip;
+        originPool->requestSent(replacement->ip);
+        response.requests.push_back(std::move(request));
+    }
+    replacement->pending = std::move(queued);
+    // a warm connection can take them right away, a new one sends them once connected
+    if (!replacement->connecting)
+    {
+        loop.setWriteInterest(replacementSocket, true);
+        flushPending(loop, replacementSocket);
+    }
+}
+
+// The handshake of a server connection finished, the socket turned writable or reported an error.
+// Returns false when it failed and the connection is gone.
+bool finishConnect(EventLoop &loop, int upstreamSocket)
+{
+    Connection *upstream = connections.find(upstreamSocket);
+    int error = 0;
+    socklen_t errorLen = sizeof(error);
+    if (getsockopt(upstreamSocket, SOL_SOCKET, SO_ERROR, &error, &errorLen) == STATUS_ERROR)
+    {
+        error = errno;
+    }
+    if (error != 0)
+    {
+        connectFailed(loop, upstreamSocket, error);
+        return false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    upstream->connecting = false;
+    metrics->connectSeconds.observe(std::chrono::duration<double>(now - upstream->connectStarted).count());
+    // the requests only go out now, the handshake is not part of their response time
+    for (InFlightRequest &request : upstream->response->requests)
+    {
+        request.sentAt = now;
+    }
+    return true;
+}
+
+// give up on server connections that were not accepted within CONNECT_TIMEOUT_MS
+void expireConnects(EventLoop &loop, std::chrono::steady_clock::time_point now)
+{
+    // failing over may start new connections, which go on the list again
+    std::vector<int> sockets;
+    sockets.swap(connectingUpstreams);
+    for (int upstreamSocket : sockets)
+    {
+        Connection *upstream = connections.find(upstreamSocket);
+        if (upstream == nullptr || upstream->kind != Connection::Kind::Upstream || !upstream->connecting)
+        {
+            continue;
+        }
+        if (now - upstream->connectStarted >= std::chrono::milliseconds(CONNECT_TIMEOUT_MS))
+        {
+            connectFailed(loop, upstreamSocket, ETIMEDOUT);
+        }
+        else
+        {
+            connectingUpstreams.push_back(upstreamSocket);
+        }
     }
 }
 
-void resolveHost(Argument &args)
+// how long the event loop may sleep before a connection attempt times out, -1 when none is under way
+int nextConnectTimeoutMs(std::chrono::steady_clock::time_point now)
 {
-    if (args.upstream_host_name.empty())
+    auto earliest = std::chrono::steady_clock::time_point::max();
+    for (int upstreamSocket : connectingUpstreams)
+    {
+        Connection *upstream = connections.find(upstreamSocket);
+        if (upstream != nullptr && upstream->kind == Connection::Kind::Upstream && upstream->connecting)
+        {
+            earliest = std::min(earliest, upstream->connectStarted + std::chrono::milliseconds(CONNECT_TIMEOUT_MS));
+        }
+    }
+    if (earliest == std::chrono::steady_clock::time_point::max())
+    {
+        return -1;
+    }
+    // rounded up, waking a little late beats spinning until the deadline
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(earliest - now).count();
+    return (int)std::max<int64_t>(wait, 0);
+}
+
+// queue a cached segment response for the browser and log it like a downloaded chunk; the
+// throughput estimate is left alone since nothing was measured against the server
+void serveCachedResponse(EventLoop &loop, int clientSocket, const CachedResponse &response, LogData entry,
+                         const std::shared_ptr<AbrSession> &session, std::chrono::steady_clock::time_point startTime)
+{
+    sendDataComplete(loop, clientSocket, response->data(), response->size());
+    metrics->bytesToBrowsers.add(response->size());
+
+    entry.duration = std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count(),
+                              TransferTiming::MIN_SECONDS);
+    entry.throughput = response->size() * 8.0 / entry.duration / 1000.0;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        entry.avgThroughput = session->avgThroughput;
+        // the player still gets the segment, so it still fills the buffer estimate
+        session->chunkDelivered(std::chrono::steady_clock::now());
+    }
+    writeLogLine(entry);
+
+    if (prefetchDepth > 0)
+    {
+        prefetchAfter(loop, connections.find(clientSocket)->origin, session, entry.chunkName);
+    }
+}
+
+// A complete request from a browser, parsed in place in its receive buffer: pick the bitrate for
+// chunk requests, answer from the segment cache when possible, otherwise forward the request with
+// the file name rewritten to the chosen quality
+void handleClientData(EventLoop &loop, int socket, const char *data, const HttpRequest &httpRequest)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    Connection *client = connections.find(socket);
+    LogData request;
+    request.browserIp = client->ip;
+    request.serverIp = client->origin.empty() ? originPool->select("") : client->origin;
+    std::shared_ptr<AbrSession> session;
+    std::string_view fileName = httpRequest.fileName();
+    std::string requestName(fileName);
+
+    // a video chunk request gets the bitrate this viewer's state calls for
+    if (httpRequest.method == "GET" && fileName.ends_with(".ts"))
+    {
+        request.chunkRequest = true;
+        request.chunkName = requestName;
+        request.videoName = videoNameOf(request.chunkName);
+        session = abrSessions.get(request.browserIp, request.videoName);
+
+        // the configured policy picks the bitrate from this viewer's state
+        std::lock_guard<std::mutex> lock(session->mutex);
+        if (session->ladder == nullptr)
+        {
+            // playlist was fetched before the proxy saw it for this viewer, start from the lowest bitrate
+            std::shared_ptr<const BitrateLadder> ladder = manifestCache.get(request.videoName);
+            if (ladder != nullptr)
+            {
+                session->restart(ladder);
+            }
+        }
+        if (session->timeline == nullptr)
+        {
+            session->timeline = manifestCache.getTimeline(request.videoName);
+        }
+        size_t segment = segmentNumberOf(request.chunkName);
+        session->inFlightSeconds = session->segmentDuration(segment);
+        if (session->ladder != nullptr)
+        {
+            size_t rung = abrPolicy->select(*session, segment);
+            session->lastRung = rung;
+            request.bitrate = session->ladder->bandwidths[rung];
+            requestName = modifyURL(request.chunkName, session->ladder->qualityNames[rung]);
+        }
+        // prefetched segments are requested next to the ones the player asks for
+        session->chunkPath = std::string(httpRequest.uri.substr(0, fileName.data() - httpRequest.uri.data()));
+    }
+
+    // the request as forwarded: everything up to the file name, the (new) file name, the rest
+    size_t nameOffset = httpRequest.fileNameOffset();
+    std::string_view before(data, nameOffset);
+    std::string_view after(data + nameOffset + fileName.size(), httpRequest.length - nameOffset - fileName.size());
+
+    // identical segments are fetched from the server once and then served from memory; a browser
+    // with responses still on the way is not answered from the cache, it would overtake them
+    bool fillCache = false;
+    bool responsesPending = client->peer != -1;
+    if (request.chunkRequest && segmentCache != nullptr && !responsesPending)
+    {
+        CachedResponse cached;
+        SegmentCache::Waiter waiter = {cacheMailbox, socket, client->sessionId};
+        SegmentCache::Lookup lookup = segmentCache->acquire(requestName, waiter, cached);
+        if (lookup == SegmentCache::Lookup::Hit)
+        {
+            metrics->cacheHits.add();
+            serveCachedResponse(loop, socket, cached, request, session, startTime);
+            return;
+        }
+        if (lookup == SegmentCache::Lookup::Wait)
+        {
+            metrics->cacheWaits.add();
+            client->parked = std::make_unique<ParkedRequest>();
+            ParkedRequest &parked = *client->parked;
+            parked.request.reserve(httpRequest.length - fileName.size() + requestName.size());
+            parked.request.insert(parked.request.end(), before.begin(), before.end());
+            parked.request.insert(parked.request.end(), requestName.begin(), requestName.end());
+            parked.request.insert(parked.request.end(), after.begin(), after.end());
+            parked.log = request;
+            parked.session = session;
+            parked.startTime = startTime;
+            return;
+        }
+        metrics->cacheMisses.add();
+        fillCache = true;
+    }
+
+    // the response carries what is needed to log it and update the viewer's estimate
+    InFlightRequest inFlight;
+    inFlight.log = request;
+    inFlight.session = session;
+    inFlight.requestName = requestName;
+    inFlight.headRequest = httpRequest.method == "HEAD";
+    if (fillCache)
+    {
+        inFlight.cacheKey = requestName;
+    }
+    forwardRequest(loop, socket, std::move(inFlight), httpRequest.keepAlive, {before, requestName, after});
+}
+
+// Handle every complete request waiting in a browser's receive buffer, in order. Stops at a request
+// parked on the cache, the ones after it stay buffered until it is answered.
+void processClientRequests(EventLoop &loop, int socket)
+{
+    // nothing can be forwarded before the nameserver said where to
+    Connection *client = connections.find(socket);
+    if (client == nullptr || client->resolving)
+    {
         return;
+    }
 
-    // Create socket for communication with dns
-    int resolveSocket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (resolveSocket < 0)
+    size_t offset = 0;
+    while (client->parked == nullptr)
     {
-        std::cerr << "Resolve socket creation failed" << std::endl;
-        exit(1);
+        std::vector<char> &buffered = client->requestBuffer;
+        HttpRequest request;
+        ParseResult result = parseRequest(std::string_view(buffered.data() + offset, buffered.size() - offset), request);
+        if (result == ParseResult::Error || (result == ParseResult::Incomplete && buffered.size() - offset > MAX_HEADER_SIZE))
+        {
+            closeClient(loop, socket);
+            return;
+        }
+        if (result == ParseResult::Incomplete)
+        {
+            break;
+        }
+        handleClientData(loop, socket, buffered.data() + offset, request);
+        offset += request.length;
+        // a failed send may have closed the browser
+        if (connections.find(socket) != client)
+        {
+            return;
+        }
     }
 
-    // Prepare request
-    sockaddr_in serverAddr;
-    memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(args.nameserver_port);
-    inet_pton(AF_INET, args.nameserver_ip.c_str(), &serverAddr.sin_addr);
-    DNSMessage msg;
-    DNSHeader msgHeader;
-    msgHeader.ANCOUNT = 0;
-    msgHeader.NSCOUNT = 0;
-    msgHeader.QR = 0;
-    msgHeader.ID = 0;
-    msgHeader.QDCOUNT = 1;
-    msgHeader.OPCODE = DNSOpcode::QUERY;
-
-    msg.header = msgHeader;
-    msg.question.QNAME = DNSDomainName::fromString(args.upstream_host_name);
-    msg.question.QTYPE = DNSQType::A;
-    msg.question.QCLASS = DNSQClass::IN;
-    std::vector<std::byte> serializedData = msg.serialize();
-    int status = sendto(resolveSocket, serializedData.data(), serializedData.size(), 0, (struct sockaddr *)&serverAddr, sizeof(serverAddr));
-
-    if (status == STATUS_ERROR)
-    {
-        close(resolveSocket);
-        perror("Send UDP dns Error!");
-        exit(1);
+    // an idle connection keeps no receive buffer around
+    std::vector<char> &buffered = client->requestBuffer;
+    if (offset >= buffered.size())
+    {
+        std::vector<char>().swap(buffered);
+        return;
     }
+    buffered.erase(buffered.begin(), buffered.begin() + offset);
+}
 
-    // Prepare receive dns query response
-    std::byte buffer[MAX_BUFFER_SIZE];
-    socklen_t addrLen = sizeof(serverAddr);
-    int numBytesReceived = recvfrom(resolveSocket, buffer, sizeof(buffer), 0, (struct sockaddr *)&serverAddr, &addrLen);
-    if (numBytesReceived == STATUS_ERROR)
+// pick up segments other sessions fetched for the requests this worker has parked
+void deliverCachedSegments(EventLoop &loop)
+{
+    for (CacheMailbox::Delivery &delivery : cacheMailbox->take())
     {
-        close(resolveSocket);
-        perror("Receive UDP dns Error!");
-        exit(1);
+        Connection *client = connections.find(delivery.clientSocket);
+        if (client == nullptr || client->sessionId != delivery.sessionId || client->parked == nullptr)
+        {
+            continue; // the browser went away in the meantime
+        }
+
+        ParkedRequest request = std::move(*client->parked);
+        client->parked.reset();
+
+        if (delivery.response != nullptr)
+        {
+            serveCachedResponse(loop, delivery.clientSocket, delivery.response, request.log, request.session, request.startTime);
+        }
+        else
+        {
+            // the fetch we were waiting on failed, send our own request to the server
+            InFlightRequest inFlight;
+            inFlight.log = request.log;
+            inFlight.session = request.session;
+            inFlight.requestName = request.log.chunkName;
+            std::string_view bytes(request.request.data(), request.request.size());
+            forwardRequest(loop, delivery.clientSocket, std::move(inFlight), true, {bytes});
+        }
+
+        // carry on with whatever the browser sent while it was parked
+        processClientRequests(loop, delivery.clientSocket);
+    }
+}
+
+// Function to handle communication, returns false once the socket has nothing more to read or was closed
+bool processConnection(int socket, EventLoop &loop, double alpha)
+{
+    char buffer[MAX_BUFFER_SIZE];
+
+    Connection *conn = connections.find(socket);
+    if (conn == nullptr)
+    {
+        return false;
+    }
+
+    // segment bodies in splice mode skip the recv() path entirely
+    if (conn->kind == Connection::Kind::Upstream && conn->response->splicing && conn->peer != -1)
+    {
+        return spliceResponseBody(loop, socket, conn->peer, alpha);
+    }
+
+    // browser bytes go straight into its receive buffer, requests are parsed in place there
+    bool fromClient = conn->kind == Connection::Kind::Browser;
+    int numReceivedBytes;
+    if (fromClient)
+    {
+        std::vector<char> &received = conn->requestBuffer;
+        size_t used = received.size();
+        received.resize(used + MAX_BUFFER_SIZE);
+        numReceivedBytes = recv(socket, received.data() + used, MAX_BUFFER_SIZE, 0);
+        received.resize(used + std::max(numReceivedBytes, 0));
+        metrics->bytesFromBrowsers.add(std::max(numReceivedBytes, 0));
+    }
+    else
+    {
+        numReceivedBytes = recv(socket, buffer, MAX_BUFFER_SIZE, 0);
+    }
+
+    if (numReceivedBytes == STATUS_ERROR)
+    {
+        // Ignore possible linux error, the socket is drained until the next edge
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return false;
+        }
+        if (errno == EINTR)
+        {
+            return true;
+        }
     }
 
-    // Deserialize the data
-    try
+    // nothing is communication or the connection broke, need to close connection
+    if (numReceivedBytes <= 0)
     {
-        DNSMessage responseData = DNSMessage::deserialize(std::span(buffer, numBytesReceived));
-        // Loop through answers to find the ip
-        for (auto &ans : responseData.answers)
-            if (ans.TYPE == DNSRRType::A)
+        // this is a client socket, close corresponding server connection and clear out data
+        if (fromClient)
+        {
+            closeClient(loop, socket);
+        }
+        // upstream socket
+        else
+        {
+            closeUpstream(loop, socket);
+        }
+        return false;
+    }
+
+    // Handle received bytes
+    // Check if data is from client or upstream and forward appropriately
+    if (fromClient)
+    {
+        // Data received from client, handle the requests it completes
+        processClientRequests(loop, socket);
+    }
+    else
+    {
+        // Data received from upstream server, stream it through to the browser holding the connection
+        if (conn->peer != -1)
+        {
+            int clientSocket = conn->peer;
+            relayResponseData(loop, socket, clientSocket, buffer, numReceivedBytes, alpha);
+            if (!isTracked(socket))
             {
-                std::string rawAddrString = std::get<DNSResourceRecord::RecordDataTypes::A>(ans.RDATA).toString();
-                // Convert address to string representation
+                return false;
+            }
 
-                char addrBuffer[rawAddrString.length() + 1];
-                std::strcpy(addrBuffer, rawAddrString.c_str());
-                args.upstream_host_ip = addrBuffer;
-                break;
+            // back off while the browser cannot keep up, flushPending resumes us; a connection
+            // already back in the pool has nothing more to send it
+            Connection *client = connections.find(clientSocket);
+            if (conn->peer == clientSocket && client != nullptr && client->pending.size() > RELAY_HIGH_WATERMARK)
+            {
+                conn->response->paused = true;
+                return false;
             }
+            return true;
+        }
+
+        // segments fetched ahead belong to no browser yet
+        if (conn->prefetch)
+        {
+            relayResponseData(loop, socket, STATUS_ERROR, buffer, numReceivedBytes, alpha);
+            return isTracked(socket);
+        }
     }
-    catch (const std::exception &e)
+    return true;
+}
+
+// pick up reading from a paused server once its browser has drained below the low watermark; server
+// connections get EPOLLOUT too while a request to them is queued, those have nothing to resume
+void resumeRelay(EventLoop &loop, int clientSocket, double alpha)
+{
+    Connection *client = connections.find(clientSocket);
+    if (client == nullptr || client->kind != Connection::Kind::Browser)
+    {
+        return;
+    }
+    Connection *upstream = connections.find(client->peer);
+    if (upstream == nullptr || upstream->response == nullptr || !upstream->response->paused)
+    {
+        return;
+    }
+    if (client->pending.size() > RELAY_LOW_WATERMARK)
+    {
+        return;
+    }
+
+    int upstreamSocket = client->peer;
+    upstream->response->paused = false;
+    // edge-triggered, so data that arrived while paused has to be read without a new event
+    while (isTracked(upstreamSocket) && processConnection(upstreamSocket, loop, alpha))
     {
-        perror("deseralization error");
-        exit(1);
     }
 }
 
-int main(int argc, char *argv[])
+// browsers the nameserver answered for can have their requests forwarded now
+void finishLookups(EventLoop &loop, const std::vector<DnsResolver::Answer> &answers)
 {
-    Argument args;
-    parsingArgument(argc, argv, args);
-    resolveHost(args);
-    // Create the log file for logging
-    log_file.open(args.log_file_name);
-    if (!log_file.is_open())
+    for (const DnsResolver::Answer &answer : answers)
     {
-        std::cerr << "Log file failed to open" << std::endl;
-        return 1;
+        auto waiting = resolvingClients.find(answer.token);
+        if (waiting == resolvingClients.end())
+        {
+            continue; // the browser went away in the meantime
+        }
+        int clientSocket = waiting->second;
+        resolvingClients.erase(waiting);
+
+        if (answer.addresses.empty())
+        {
+            std::cerr << "Could not resolve " << originName << std::endl;
+            closeClient(loop, clientSocket);
+            continue;
+        }
+        Connection *client = connections.find(clientSocket);
+        client->resolving = false;
+        useOrigins(*client, answer.addresses);
+        processClientRequests(loop, clientSocket);
     }
+}
+
+void runWorker(const Argument &args)
+{
+    metrics = metricsRegistry.addWorker();
 
     // Create the main socket for accepting connections
-    int mainSocket = CreateMainSocket(args.proxy_host, args.proxy_port);
+    int mainSocket = CreateMainSocket(args.proxy_host, args.proxy_port, args.workers > 1);
+
+    // Register the main socket with epoll, connections get added as they are accepted
+    EventLoop loop;
+    loop.add(mainSocket);
 
-    // Create a set for select handling
-    fd_set mainSet;
-    fd_set readSet;
-    fd_set writeSet;
-    FD_ZERO(&mainSet);
-    FD_ZERO(&readSet);
-    FD_ZERO(&writeSet);
+    // segments fetched by other sessions for our parked requests arrive through this inbox
+    CacheMailbox mailbox;
+    cacheMailbox = &mailbox;
+    loop.add(mailbox.fd());
 
-    // Add mainSocket to the mainSet
-    FD_SET(mainSocket, &mainSet);
-    int maxFd = mainSocket;
+    // the origin is looked up per browser connection when it is given by name
+    std::unique_ptr<DnsResolver> nameserver;
+    if (!originName.empty())
+    {
+        nameserver = std::make_unique<DnsResolver>(args.nameserver_ip, args.nameserver_port);
+        resolver = nameserver.get();
+        loop.add(resolver->fd());
+    }
 
     // Main loop to handle incoming connections, new or existing
     while (true)
     {
-        // Must re-initialize read and write sets since they are modified
-        readSet = mainSet;
-        writeSet = mainSet;
-
-        // todo first nullptr later is writeset
-        int status = select(maxFd + 1, &readSet, &writeSet, nullptr, nullptr);
-        if (status == STATUS_ERROR)
+        // only sockets that actually became ready are returned, no scan over every fd; a nameserver
+        // query or an origin connection that may time out bounds the wait
+        auto now = std::chrono::steady_clock::now();
+        int timeoutMs = nextConnectTimeoutMs(now);
+        int lookupTimeoutMs = resolver == nullptr ? -1 : resolver->nextTimeoutMs(now);
+        if (timeoutMs == -1 || (lookupTimeoutMs != -1 && lookupTimeoutMs < timeoutMs))
         {
-            perror("Select Error!");
-            exit(3);
+            timeoutMs = lookupTimeoutMs;
         }
-
-        for (int socket = 0; socket <= maxFd; socket++)
+        std::span<epoll_event> ready = loop.wait(timeoutMs);
+        auto batchStart = std::chrono::steady_clock::now();
+        for (epoll_event &event : ready)
         {
-            if (FD_ISSET(socket, &readSet))
+            int socket = event.data.fd;
+
+            // Handle new connections, edge-triggered so drain the whole accept queue
+            if (socket == mainSocket)
             {
-                // Handle first connection using accept()
-                if (socket == mainSocket)
+                while (createConnection(mainSocket, loop) != STATUS_ERROR)
                 {
-                    int newFd = createConnection(mainSocket, mainSet, args);
+                }
+                continue;
+            }
 
-                    if (newFd > maxFd)
-                        maxFd = newFd;
+            if (socket == mailbox.fd())
+            {
+                deliverCachedSegments(loop);
+                continue;
+            }
+
+            if (resolver != nullptr && socket == resolver->fd())
+            {
+                finishLookups(loop, resolver->receive());
+                continue;
+            }
+
+            // an earlier event in this batch may already have torn the pair down
+            if (!isTracked(socket))
+            {
+                continue;
+            }
+
+            // a server connection still connecting only waits for the outcome of its handshake
+            if (connections.find(socket)->connecting)
+            {
+                if (!(event.events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) || !finishConnect(loop, socket))
+                {
+                    continue;
+                }
+            }
+
+            if (event.events & EPOLLOUT)
+            {
+                flushPending(loop, socket);
+                Connection *conn = connections.find(socket);
+                if (conn->closeAfterFlush)
+                {
+                    if (conn->pending.empty())
+                    {
+                        closeClient(loop, socket);
+                    }
+                    continue;
                 }
-                else
+                resumeRelay(loop, socket, args.adap_gain);
+            }
+
+            // a paused server is only read again once its browser caught up
+            Connection *conn = connections.find(socket);
+            if (conn == nullptr || (conn->response != nullptr && conn->response->paused))
+            {
+                continue;
+            }
+
+            // Handle existing connection, read until the kernel buffer is empty
+            if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                while (processConnection(socket, loop, args.adap_gain))
                 {
-                    // Handle existing connection
-                    processConnection(socket, mainSet, args.adap_gain, args.adap_multiplier);
                 }
             }
         }
+
+        // retry or give up on nameserver queries whose answer is late
+        if (resolver != nullptr)
+        {
+            finishLookups(loop, resolver->expire(std::chrono::steady_clock::now()));
+        }
+
+        // move on from origins that did not accept a connection in time
+        expireConnects(loop, std::chrono::steady_clock::now());
+
+        if (!ready.empty())
+        {
+            metrics->loopIterationSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count());
+        }
     }
 
     // Close all sockets before exiting
     close(mainSocket);
-    for (auto &pair : clientToUpstreamMap)
+    connections.closeAll();
+}
+
+// every proxied session costs two descriptors, so lift the soft limit as far as allowed
+void raiseFileLimit()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Argument args;
+    parsingArgument(argc, argv, args);
+    // Create the log file for logging
+    if (!chunkLog.open(args.log_file_name))
+    {
+        std::cerr << "Log file failed to open" << std::endl;
+        return 1;
+    }
+
+    raiseFileLimit();
+    spliceBodies = args.splice_bodies;
+    sampleTcpInfo = args.tcp_info;
+    originName = args.upstream_host_name;
+    originPort = args.upstream_port;
+    originPool = new OriginPool(originPort);
+    for (const std::string &host : args.upstream_host_ips)
+    {
+        originPool->add(host);
+    }
+    originPool->startProbing();
+    if (!originName.empty() && args.nameserver_ip.empty())
+    {
+        std::cerr << "Upstream server " << originName << " is a name, --nameserver-ip is needed to resolve it" << std::endl;
+        exit(1);
+    }
+    abrPolicy = AbrPolicy::create(args.abr, args.adap_multiplier);
+    if (abrPolicy == nullptr)
+    {
+        std::cerr << "Unknown ABR policy " << args.abr << ", expected throughput, buffer or mpc" << std::endl;
+        exit(1);
+    }
+    // prefetched segments wait in the segment cache, so prefetching needs one
+    prefetchDepth = std::max(args.prefetch, 0);
+    if (args.cache_size_mb <= 0 && prefetchDepth > 0)
     {
-        close(pair.first);  // Close client socket
-        close(pair.second); // Close upstream socket
+        args.cache_size_mb = DEFAULT_PREFETCH_CACHE_MB;
     }
-    log_file.close();
+    if (args.cache_size_mb > 0)
+    {
+        segmentCache = new SegmentCache((size_t)args.cache_size_mb * 1024 * 1024);
+    }
+
+    if (args.metrics_port > 0 && !startMetricsServer(metricsRegistry, args.proxy_host, args.metrics_port))
+    {
+        exit(1);
+    }
+
+    // one worker per core when asked for 0
+    if (args.workers <= 0)
+    {
+        args.workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // the first worker runs on the main thread, the rest get a thread each
+    std::vector<std::thread> workers;
+    for (int i = 1; i < args.workers; i++)
+    {
+        workers.emplace_back(runWorker, std::cref(args));
+    }
+    runWorker(args);
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    chunkLog.close();
     return 0;
-}
\ No newline at end of file
+}
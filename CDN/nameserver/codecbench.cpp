@@ -0,0 +1,86 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "DNS/DNSMessage.h"
+#include "DNS/DNSMessageView.h"
+
+// usage: codecbench [iterations]
+// Time per message of the DNS codec paths on a response with four A records, the shape the
+// nameserver and miProxy's resolver handle.
+
+// keeps the optimizer from dropping the work being timed
+volatile size_t sink;
+
+template <typename Work>
+void measure(const char *name, int iterations, Work work)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        sink = work();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    printf("%-40s %10.1f ns/message\n", name, elapsed.count() / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+
+    DNSMessage message{};
+    message.header.ID = 0x1234;
+    message.header.QR = 1;
+    message.header.RD = 1;
+    message.header.QDCOUNT = 1;
+    message.question.QNAME = DNSDomainName::fromString("video.cse.umich.edu");
+    message.question.QTYPE = DNSQType::A;
+    message.question.QCLASS = DNSQClass::IN;
+    for (std::string ip : {"10.0.0.1", "10.0.0.2", "10.0.0.3", "10.0.0.4"})
+    {
+        DNSResourceRecord answer;
+        answer.NAME = message.question.QNAME;
+        answer.TYPE = DNSRRType::A;
+        answer.CLASS = DNSRRClass::IN;
+        answer.TTL = 0;
+        answer.RDLENGTH = 4;
+        answer.RDATA = DNSResourceRecord::RecordDataTypes::A(ip);
+        message.answers.push_back(answer);
+    }
+    message.header.ANCOUNT = message.answers.size();
+    std::vector<std::byte> packet = message.serialize();
+
+    // the parts concatenated through DNSSerializationBuffer, how messages used to be put together
+    measure("serialize, buffer per part", iterations, [&] {
+        DNSSerializationBuffer buffer;
+        buffer.concat(message.header.serialize());
+        buffer.concat(message.question.serialize());
+        for (DNSResourceRecord &answer : message.answers)
+        {
+            buffer.concat(answer.serialize());
+        }
+        return buffer.data().size();
+    });
+    measure("serialize into a vector", iterations, [&] {
+        return message.serialize().size();
+    });
+    std::byte out[512];
+    measure("serialize into a caller's span", iterations, [&] {
+        return message.serialize(std::span(out));
+    });
+    measure("deserialize into DNSMessage", iterations, [&] {
+        return DNSMessage::deserialize(packet).answers.size();
+    });
+    measure("deserialize a view, walk the answers", iterations, [&] {
+        DNSMessageView view = DNSMessageView::deserialize(packet);
+        DNSWireReader answers = view.answers();
+        size_t total = 0;
+        for (int i = 0; i < view.header.ANCOUNT; i++)
+        {
+            total += DNSResourceRecordView::deserialize(answers).RDATA.size();
+        }
+        return total + view.question.QNAME.matches("video.cse.umich.edu");
+    });
+    return 0;
+}
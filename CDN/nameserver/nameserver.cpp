@@ -16,6 +16,12 @@
 #include <ctime>
 #include <chrono>
 #include <queue>
+#include <unordered_map>
+#include <limits>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include "DNS/DNSMessage.h"
 
 class Argument
@@ -27,6 +33,7 @@ public:
     std::string log_file_name = "nameserver_log.txt";
     std::string round_robin_file_name = "";
     std::string topology_file_name = "";
+    int threads = 1;
 };
 
 class LogData 
@@ -42,6 +49,15 @@ struct Node {
     std::string type;
 };
 
+// the topology as a compressed sparse row graph: nodes are numbered densely in ascending id order,
+// and the links of node i are targets[offsets[i] .. offsets[i + 1]) with the matching costs
+struct Graph {
+    std::vector<Node> nodes;
+    std::vector<int> offsets;
+    std::vector<int> targets;
+    std::vector<int> costs;
+};
+
 // Function to parse the command line arguments
 void parsingArgument(int argc, char *argv[], Argument &args)
 {
@@ -59,6 +75,8 @@ void parsingArgument(int argc, char *argv[], Argument &args)
             args.round_robin_file_name = argv[++i];
         else if (strcmp(argv[i], "--network-topology-file-path") == 0)
             args.topology_file_name = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0)
+            args.threads = atoi(argv[++i]);
     }
 }
 
@@ -73,34 +91,63 @@ void loadRRFile(std::string fileDir, std::vector<std::string> &IPs)
     file.close();
 }
 
-// load and parse the topology file into links and nodes
-void loadTopology(std::string fileDir, std::map<int, Node> &nodes, std::map<std::pair<int, int>, int> &links) 
+// load and parse the topology file into a CSR graph; a link listed twice keeps its last cost
+void loadTopology(std::string fileDir, Graph &graph) 
 {
     int numNodes, numLinks;
     std::ifstream file(fileDir);
     std::string line;
     
-    // read all the nodes
+    // read all the nodes, numbered by their position in ascending id order
     file >> line >> numNodes;
+    std::vector<std::pair<int, Node>> nodes(numNodes);
     for (int i = 0; i < numNodes; i++) {
-        int nodeId;
-        std::string type, ip;
-        file >> nodeId >> type >> ip;
-        nodes[nodeId] = {ip, type};
+        file >> nodes[i].first >> nodes[i].second.type >> nodes[i].second.ip;
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    std::unordered_map<int, int> indexOf;
+    for (int i = 0; i < numNodes; i++) {
+        indexOf[nodes[i].first] = i;
+        graph.nodes.push_back(nodes[i].second);
     }
 
-    // read all the links 
+    // read all the links, both directions
+    struct Link {
+        int start, dest, cost, order;
+    };
+    std::vector<Link> links;
     file >> line >> numLinks;
     for (int i = 0; i < numLinks; i++) {
         int start, dest, cost;
         file >> start >> dest >> cost;
-        links[{start, dest}] = cost;
-        links[{dest, start}] = cost;
+        auto from = indexOf.find(start), to = indexOf.find(dest);
+        if (from == indexOf.end() || to == indexOf.end()) {
+            continue;
+        }
+        links.push_back({from->second, to->second, cost, i});
+        links.push_back({to->second, from->second, cost, i});
+    }
+    std::sort(links.begin(), links.end(), [](const Link &a, const Link &b) {
+        return std::tie(a.start, a.dest, a.order) < std::tie(b.start, b.dest, b.order);
+    });
+
+    graph.offsets.assign(numNodes + 1, 0);
+    for (size_t i = 0; i < links.size(); i++) {
+        // of duplicate links only the last one listed counts
+        if (i + 1 < links.size() && links[i + 1].start == links[i].start && links[i + 1].dest == links[i].dest) {
+            continue;
+        }
+        graph.targets.push_back(links[i].dest);
+        graph.costs.push_back(links[i].cost);
+        graph.offsets[links[i].start + 1]++;
+    }
+    for (int i = 0; i < numNodes; i++) {
+        graph.offsets[i + 1] += graph.offsets[i];
     }
 }
 
-//start the DNS server with UDP
-int startDNS(std::string ip, int port) 
+//start the DNS server with UDP, with reusePort every thread binds its own socket to the same port
+int startDNS(std::string ip, int port, bool reusePort) 
 {
     int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     int opt = 1;
@@ -109,6 +156,11 @@ int startDNS(std::string ip, int port)
         close(sockfd);
         exit(1);
     }
+    if (reusePort && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("Reuse port error");
+        close(sockfd);
+        exit(1);
+    }
     if (sockfd < 0) {
         perror("Open error");
         exit(1);
@@ -130,104 +182,330 @@ int startDNS(std::string ip, int port)
 
 }
 
-// find the closest server node to this client node
-Node findClosestServer(int clientNodeId, const std::map<int, Node> &nodes, const std::map<std::pair<int, int>, int> &links) {
-    std::map<int, int> distances;
-    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<>> pq;
-
-    for (const auto &node : nodes) {
-        distances[node.first] = std::numeric_limits<int>::max();
+// Closest server of every client, computed once: a single Dijkstra run starting from all servers
+// at once labels each node with its distance to the nearest server and which one that is. Ties go
+// to the server with the lowest node id. Clients are keyed by their address in network byte order,
+// a client listed twice gets the answer of the one with the higher id.
+std::unordered_map<uint32_t, std::string> computeClosestServers(const Graph &graph) {
+    size_t numNodes = graph.nodes.size();
+    std::vector<int64_t> distances(numNodes, std::numeric_limits<int64_t>::max());
+    std::vector<int> closest(numNodes, -1);
+
+    // (distance, server, node): the server is part of the key so ties resolve the same every time
+    using Entry = std::tuple<int64_t, int, int>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<>> pq;
+    for (int i = 0; i < (int)numNodes; i++) {
+        if (graph.nodes[i].type == "SERVER") {
+            distances[i] = 0;
+            closest[i] = i;
+            pq.push({0, i, i});
+        }
     }
 
-    distances[clientNodeId] = 0;
-    pq.push({0, clientNodeId});
-
     while (!pq.empty()) {
-        auto [dist, nodeId] = pq.top();
+        auto [dist, server, nodeId] = pq.top();
         pq.pop();
 
-        if (dist > distances[nodeId]) continue;
+        if (dist != distances[nodeId] || server != closest[nodeId]) continue;
 
-        for (const auto &link : links) {
-            if (link.first.first == nodeId) {
-                int neighbor = link.first.second;
-                int newDist = dist + link.second;
+        for (int i = graph.offsets[nodeId]; i < graph.offsets[nodeId + 1]; i++) {
+            int neighbor = graph.targets[i];
+            int64_t newDist = dist + graph.costs[i];
 
-                if (newDist < distances[neighbor]) {
-                    distances[neighbor] = newDist;
-                    pq.push({newDist, neighbor});
-                }
+            if (std::tie(newDist, server) < std::tie(distances[neighbor], closest[neighbor])) {
+                distances[neighbor] = newDist;
+                closest[neighbor] = server;
+                pq.push({newDist, server, neighbor});
             }
         }
     }
 
-    // Find the closest server
-    Node closestServer = Node();
-    int minDistance = std::numeric_limits<int>::max();
-    for (const auto &node : nodes) {
-        if (node.second.type == "SERVER" && distances[node.first] < minDistance) {
-            minDistance = distances[node.first];
-            closestServer = node.second;
+    std::unordered_map<uint32_t, std::string> closestServers;
+    for (size_t i = 0; i < numNodes; i++) {
+        in_addr address;
+        if (graph.nodes[i].type == "CLIENT" && closest[i] != -1 && inet_pton(AF_INET, graph.nodes[i].ip.c_str(), &address) == 1) {
+            closestServers[address.s_addr] = graph.nodes[closest[i]].ip;
         }
     }
-
-    return closestServer;
+    return closestServers;
 }
 
-//get the next ip from the RR file and update index 
-std::string getNextRoundRobinIP(std::vector<std::string> &ipList, int &index) {
+//get the next ip from the RR file and advance the index shared by all threads
+std::string getNextRoundRobinIP(const std::vector<std::string> &ipList, std::atomic<size_t> &index) {
     if (ipList.empty()) return "";
-    std::string ip = ipList[index];
-    index = (index + 1) % ipList.size();
-    return ip;
+    return ipList[index.fetch_add(1, std::memory_order_relaxed) % ipList.size()];
+}
+
+// how many datagrams a thread receives with one recvmmsg and answers with one sendmmsg
+constexpr int BATCH_SIZE = 64;
+constexpr size_t MAX_QUERY_SIZE = 1024;
+// a reply repeats the query and adds at most one answer with a name of up to 255 bytes
+constexpr size_t MAX_REPLY_SIZE = 2048;
+
+// the complete reply to a plain A query for the configured domain pointing at one server, only the
+// ID and RD bit are taken from the query; the question sits right after the 12 byte header
+struct ResponseTemplate {
+    std::string ip;
+    std::vector<std::byte> bytes;
+    size_t questionSize;
+};
+
+// build the template for serverIP with the same DNSMessage serialization the full path uses
+ResponseTemplate buildResponseTemplate(const std::string &domainName, const std::string &serverIP)
+{
+    DNSMessage responseMessage{};
+    responseMessage.header.QR = 1;
+    responseMessage.header.OPCODE = DNSOpcode::QUERY;
+    responseMessage.header.RCODE = DNSRcode::NO_ERROR;
+    responseMessage.header.QDCOUNT = 1;
+    responseMessage.question.QNAME = DNSDomainName::fromString(domainName);
+    responseMessage.question.QTYPE = DNSQType::A;
+    responseMessage.question.QCLASS = DNSQClass::IN;
+
+    DNSResourceRecord answer;
+    answer.NAME = responseMessage.question.QNAME;
+    answer.TYPE = DNSRRType::A;
+    answer.CLASS = DNSRRClass::IN;
+    answer.TTL = 0;
+
+    answer.RDLENGTH = 4;
+    answer.RDATA = DNSResourceRecord::RecordDataTypes::A(serverIP);
+    responseMessage.answers.push_back(answer);
+    responseMessage.header.ANCOUNT = responseMessage.answers.size();
+
+    return {serverIP, responseMessage.serialize(), responseMessage.question.serialize().data().size()};
+}
+
+// what the threads answer from, fixed once loaded apart from the round-robin position; RR mode has
+// one template per line of the list, geolocation mode one per server and maps clients to it
+class Answers
+{
+public:
+    std::string domain_name = "";
+    bool geolocation = false;
+    std::vector<std::string> RoundRobinIPs;
+    std::atomic<size_t> index = 0;
+    std::vector<ResponseTemplate> templates;
+    std::unordered_map<uint32_t, size_t> closestServers;
+};
+
+// serialize straight into the reply buffer of a batch slot, which keeps its capacity for the next batch
+void serializeReply(DNSMessage &message, std::vector<std::byte> &reply)
+{
+    reply.resize(MAX_REPLY_SIZE);
+    reply.resize(message.serialize(std::span(reply)));
+}
+
+void appendLogLine(std::string &logLines, const LogData &currLogData)
+{
+    logLines.append(currLogData.clientIP).append(" ").append(currLogData.queryName).append(" ")
+        .append(currLogData.responseIP).append("\n");
 }
 
 // global variables to keep track of data
 std::ofstream logFile;
-LogData currLogData;
+std::mutex logFileMutex;
+
+// Answer a query that asks exactly for an A record of the configured domain from a template: the
+// header and question bytes are checked against the template, then it is copied and patched. No
+// parsing and no allocation once the reply buffer has grown. Returns false when the query has to
+// go through the full path (other names or types, extra records, unknown clients, ...).
+bool answerFromTemplate(Answers &answers, std::span<const std::byte> query, in_addr clientAddr,
+                        LogData &currLogData, std::vector<std::byte> &reply, std::string &logLines)
+{
+    if (answers.templates.empty())
+        return false;
+
+    // every template carries the same question
+    const ResponseTemplate &first = answers.templates.front();
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(query.data());
+    static const uint8_t plainCounts[8] = {0, 1, 0, 0, 0, 0, 0, 0};
+    if (query.size() != 12 + first.questionSize)
+        return false;
+    // a standard query: QR, OPCODE, AA and TC clear in the first flag byte, nothing in the second
+    if ((bytes[2] & 0xFE) != 0 || bytes[3] != 0 || memcmp(bytes + 4, plainCounts, sizeof(plainCounts)) != 0)
+        return false;
+    if (memcmp(query.data() + 12, first.bytes.data() + 12, first.questionSize) != 0)
+        return false;
+
+    const ResponseTemplate *response;
+    if (answers.geolocation)
+    {
+        auto closest = answers.closestServers.find(clientAddr.s_addr);
+        if (closest == answers.closestServers.end())
+            return false;
+        response = &answers.templates[closest->second];
+    }
+    else
+    {
+        response = &answers.templates[answers.index.fetch_add(1, std::memory_order_relaxed) % answers.templates.size()];
+    }
 
-int main(int argc, char *argv[]) {
-    Argument args;
-    parsingArgument(argc, argv, args);
+    reply.resize(response->bytes.size());
+    memcpy(reply.data(), response->bytes.data(), response->bytes.size());
+    reply[0] = query[0];
+    reply[1] = query[1];
+    reply[2] |= query[2] & std::byte{0x01};
 
-    //open log file for logging
-    logFile.open(args.log_file_name);
-    if (!logFile.is_open())
+    currLogData.queryName = answers.domain_name;
+    currLogData.responseIP = response->ip;
+    appendLogLine(logLines, currLogData);
+    return true;
+}
+
+// build the reply to one query in RR mode, false when there is nothing to send back
+bool answerRoundRobin(Answers &answers, const DNSMessage &queryMessage, LogData &currLogData,
+                      std::vector<std::byte> &reply, std::string &logLines)
+{
+    // check if domain name is valid
+    if (currLogData.queryName == answers.domain_name) 
     {
-        std::cerr << "Log file failed to open" << std::endl;
-        return 1;
+        std::string serverIP = getNextRoundRobinIP(answers.RoundRobinIPs, answers.index);
+        currLogData.responseIP = serverIP;
+        DNSMessage responseMessage = queryMessage;
+        responseMessage.header.QR = 1;
+
+        DNSResourceRecord answer;
+        answer.NAME = queryMessage.question.QNAME;
+        answer.TYPE = DNSRRType::A;
+        answer.CLASS = DNSRRClass::IN;
+        answer.TTL = 0;
+
+        answer.RDLENGTH = 4;
+        answer.RDATA = DNSResourceRecord::RecordDataTypes::A(serverIP);
+        responseMessage.answers.push_back(answer);
+        responseMessage.header.ANCOUNT = responseMessage.answers.size();
+        serializeReply(responseMessage, reply);
+
+        // logging into the log file
+        appendLogLine(logLines, currLogData);
+    }
+    else 
+    {   
+        DNSMessage responseMessage = queryMessage;
+        responseMessage.header.QR = 1;
+        responseMessage.header.RCODE = DNSRcode::NAME_ERROR;
+        serializeReply(responseMessage, reply);
     }
+    return true;
+}
 
+// build the reply to one query in geolocation mode, false when there is nothing to send back
+bool answerGeolocation(Answers &answers, DNSMessage &queryMessage, in_addr clientAddr, LogData &currLogData,
+                       std::vector<std::byte> &reply, std::string &logLines)
+{
+    // find the closest server for this client
+    Node closestServer = Node();
+    auto closest = answers.closestServers.find(clientAddr.s_addr);
+    if (closest != answers.closestServers.end())
+    {
+        closestServer = {answers.templates[closest->second].ip, "SERVER"};
+    }
+
+    // server is found and it can send 
+    if (closestServer.type != "" && answers.domain_name == currLogData.queryName)
+    {
+        currLogData.responseIP = closestServer.ip;
+        DNSMessage responseMessage = queryMessage;
+        responseMessage.header.QR = 1;
+
+        DNSResourceRecord answer;
+        answer.NAME = queryMessage.question.QNAME;
+        answer.TYPE = DNSRRType::A;
+        answer.CLASS = DNSRRClass::IN;
+        answer.TTL = 0;
+
+        answer.RDLENGTH = 4;
+        answer.RDATA = DNSResourceRecord::RecordDataTypes::A(currLogData.responseIP);
+        responseMessage.answers.push_back(answer);
+        responseMessage.header.ANCOUNT = responseMessage.answers.size();
+        serializeReply(responseMessage, reply);
+
+        // logging into the log file
+        appendLogLine(logLines, currLogData);
+        return true;
+    }
+    // server was not found or domain name did not match
+    if (answers.domain_name != currLogData.queryName) 
+    {
+        queryMessage.header.QR = 1;
+        queryMessage.header.RCODE = DNSRcode::NAME_ERROR;
+        queryMessage.answers.clear();
+        queryMessage.header.ANCOUNT = 0;
+        queryMessage.header.NSCOUNT = 0;
+        queryMessage.header.ARCOUNT = 0;
+        serializeReply(queryMessage, reply);
+        appendLogLine(logLines, currLogData);
+        return true;
+    }
+    // wasn't able to find a server for this client
+    if (closestServer.type == "")
+    {
+        queryMessage.header.QR = 1;
+        queryMessage.header.RCODE = DNSRcode::NO_ERROR;
+        serializeReply(queryMessage, reply);
+        return true;
+    }
+    return false;
+}
+
+// one server thread: its own socket, up to BATCH_SIZE queries per recvmmsg and all their replies
+// in one sendmmsg, log lines of a batch written under one lock
+void serveQueries(const Argument &args, Answers &answers)
+{
     // start the DNS server
-    int socket = startDNS(args.ip_addr, args.port);
+    int socket = startDNS(args.ip_addr, args.port, args.threads > 1);
+
+    LogData currLogData;
+    std::vector<std::array<std::byte, MAX_QUERY_SIZE>> buffers(BATCH_SIZE);
+    std::vector<std::vector<std::byte>> replies(BATCH_SIZE);
+    std::string logLines;
+
+    struct sockaddr_in clientAddrs[BATCH_SIZE];
+    struct iovec queryVecs[BATCH_SIZE], replyVecs[BATCH_SIZE];
+    struct mmsghdr queries[BATCH_SIZE], responses[BATCH_SIZE];
+    memset(queries, 0, sizeof(queries));
+    for (int i = 0; i < BATCH_SIZE; i++)
+    {
+        queryVecs[i] = {buffers[i].data(), MAX_QUERY_SIZE};
+        queries[i].msg_hdr.msg_iov = &queryVecs[i];
+        queries[i].msg_hdr.msg_iovlen = 1;
+        queries[i].msg_hdr.msg_name = &clientAddrs[i];
+    }
 
-    std::vector<std::string> RoundRobinIPs;
-    int index = 0;
-    std::map<int, Node> nodes;
-    std::map<std::pair<int, int>, int> links;
-    // check to use RR or Geological and load the corresponding files
-    //Case 1: run with RR mode
-    if (args.round_robin_file_name != "" && args.topology_file_name == "") 
+    while (true) 
     {
-        loadRRFile(args.round_robin_file_name, RoundRobinIPs);
-        while (true) 
+        for (int i = 0; i < BATCH_SIZE; i++)
+        {
+            queries[i].msg_hdr.msg_namelen = sizeof(clientAddrs[i]);
+        }
+        // block for the first query, then take whatever else is already queued
+        int received = recvmmsg(socket, queries, BATCH_SIZE, MSG_WAITFORONE, nullptr);
+        if (received < 0)
+        {
+            if (errno != EINTR)
+                perror("recvmmsg error");
+            continue;
+        }
+
+        int numReplies = 0;
+        for (int i = 0; i < received; i++)
         {
-            struct sockaddr_in client_addr{};
-            socklen_t client_addr_len = sizeof(client_addr);
-            std::byte buffer[1024];
-            client_addr_len = sizeof(client_addr);
-            int msgLen = recvfrom(socket, buffer, sizeof(buffer), 0, (struct sockaddr*)&client_addr, &client_addr_len);
+            int msgLen = queries[i].msg_len;
+            if (msgLen <= 0)
+                continue;
 
-            DNSMessage queryMessage;
+            char client_ip[INET_ADDRSTRLEN]; // Buffer for the IP address
+            inet_ntop(AF_INET, &clientAddrs[i].sin_addr, client_ip, sizeof(client_ip));
+            currLogData.clientIP = client_ip;
 
-            if (msgLen > 0)
+            std::span<const std::byte> query(buffers[i].data(), msgLen);
+            bool reply = answerFromTemplate(answers, query, clientAddrs[i].sin_addr, currLogData, replies[numReplies], logLines);
+            if (!reply)
             {
-                char client_ip[INET_ADDRSTRLEN]; // Buffer for the IP address
-                inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-                currLogData.clientIP = client_ip;
-
+                DNSMessage queryMessage;
                 try {
-                    queryMessage = DNSMessage::deserialize(std::span(buffer, msgLen));
+                    queryMessage = DNSMessage::deserialize(query);
                 } catch (const std::exception& e) {
                     perror("deseralization error");
                     continue;
@@ -236,140 +514,106 @@ int main(int argc, char *argv[]) {
                 currLogData.queryName = queryMessage.question.QNAME.toString();
                 currLogData.queryName.pop_back();
 
-                // check if domain name is valid
-                if (currLogData.queryName == args.domain_name) 
-                {
-                    std::string serverIP = getNextRoundRobinIP(RoundRobinIPs, index);
-                    currLogData.responseIP = serverIP;
-                    DNSMessage responseMessage = queryMessage;
-                    responseMessage.header.QR = 1;
-
-                    DNSResourceRecord answer;
-                    answer.NAME = queryMessage.question.QNAME;
-                    answer.TYPE = DNSRRType::A;
-                    answer.CLASS = DNSRRClass::IN;
-                    answer.TTL = 0;
-
-                    answer.RDLENGTH = 4;
-                    answer.RDATA = DNSResourceRecord::RecordDataTypes::A(serverIP);
-                    responseMessage.answers.push_back(answer);
-                    responseMessage.header.ANCOUNT = responseMessage.answers.size();
-                    auto serializedResponse = responseMessage.serialize();
-                    sendto(socket, serializedResponse.data(), serializedResponse.size(), 0, (struct sockaddr*)&client_addr, client_addr_len);
-
-                    // logging into the log file
-                    logFile << currLogData.clientIP << " " << currLogData.queryName << " " << currLogData.responseIP << std::endl;
-                }
-                else 
-                {   
-                    DNSMessage responseMessage = queryMessage;
-                    responseMessage.header.QR = 1;
-                    responseMessage.header.RCODE = DNSRcode::NAME_ERROR;
-                    auto serializedResponse = responseMessage.serialize();
-                    sendto(socket, serializedResponse.data(), serializedResponse.size(), 0, (struct sockaddr*)&client_addr, client_addr_len);
-                }
-
+                reply = answers.geolocation
+                    ? answerGeolocation(answers, queryMessage, clientAddrs[i].sin_addr, currLogData, replies[numReplies], logLines)
+                    : answerRoundRobin(answers, queryMessage, currLogData, replies[numReplies], logLines);
             }
+            if (!reply)
+                continue;
+
+            replyVecs[numReplies] = {replies[numReplies].data(), replies[numReplies].size()};
+            responses[numReplies].msg_hdr = {};
+            responses[numReplies].msg_hdr.msg_name = &clientAddrs[i];
+            responses[numReplies].msg_hdr.msg_namelen = queries[i].msg_hdr.msg_namelen;
+            responses[numReplies].msg_hdr.msg_iov = &replyVecs[numReplies];
+            responses[numReplies].msg_hdr.msg_iovlen = 1;
+            numReplies++;
         }
 
-    } 
-    // Case 2: run with geolocation mode
-    else if (args.topology_file_name != "" && args.round_robin_file_name == "") 
-    {
-        loadTopology(args.topology_file_name, nodes, links);
-
-        while (true) 
+        // sendmmsg stops at the first datagram it cannot send, that one is dropped like a failed sendto
+        for (int sent = 0; sent < numReplies;)
         {
-            struct sockaddr_in client_addr{};
-            socklen_t client_addr_len = sizeof(client_addr);
-            std::byte buffer[1024];
-            client_addr_len = sizeof(client_addr);
-            int msgLen = recvfrom(socket, buffer, sizeof(buffer), 0, (struct sockaddr*)&client_addr, &client_addr_len);
-
-            DNSMessage queryMessage;
-
-            if (msgLen > 0) {
-                char client_ip[INET_ADDRSTRLEN]; // Buffer for the IP address
-                inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-                currLogData.clientIP = client_ip;
+            int count = sendmmsg(socket, responses + sent, numReplies - sent, 0);
+            if (count < 0 && errno == EINTR)
+                continue;
+            sent += count > 0 ? count : 1;
+        }
 
-                try {
-                    queryMessage = DNSMessage::deserialize(std::span(buffer, msgLen));
-                } catch (const std::exception& e) {
-                    perror("deseralization error");
-                    continue;
-                }
+        if (!logLines.empty())
+        {
+            std::lock_guard<std::mutex> lock(logFileMutex);
+            logFile << logLines << std::flush;
+            logLines.clear();
+        }
+    }
+}
 
-                currLogData.queryName = queryMessage.question.QNAME.toString();
-                currLogData.queryName.pop_back();
+int main(int argc, char *argv[]) {
+    Argument args;
+    parsingArgument(argc, argv, args);
 
-                // find the node in the map for this client
-                Node clientNode;
-                int nodeId = -1;
-                for (auto node : nodes) 
-                {
-                    if (node.second.type == "CLIENT" && node.second.ip == currLogData.clientIP) 
-                    {
-                        clientNode = node.second;
-                        nodeId = node.first;
-                    }
-                }
+    //open log file for logging
+    logFile.open(args.log_file_name);
+    if (!logFile.is_open())
+    {
+        std::cerr << "Log file failed to open" << std::endl;
+        return 1;
+    }
 
-                Node closestServer = findClosestServer(nodeId, nodes, links);
-
-                // server is found and it can send 
-                if (closestServer.type != "" && args.domain_name == currLogData.queryName)
-                {
-                    currLogData.responseIP = closestServer.ip;
-                    DNSMessage responseMessage = queryMessage;
-                    responseMessage.header.QR = 1;
-
-                    DNSResourceRecord answer;
-                    answer.NAME = queryMessage.question.QNAME;
-                    answer.TYPE = DNSRRType::A;
-                    answer.CLASS = DNSRRClass::IN;
-                    answer.TTL = 0;
-
-                    answer.RDLENGTH = 4;
-                    answer.RDATA = DNSResourceRecord::RecordDataTypes::A(currLogData.responseIP);
-                    responseMessage.answers.push_back(answer);
-                    responseMessage.header.ANCOUNT = responseMessage.answers.size();
-                    auto serializedResponse = responseMessage.serialize();
-                    sendto(socket, serializedResponse.data(), serializedResponse.size(), 0, (struct sockaddr*)&client_addr, client_addr_len);
-
-                    // logging into the log file
-                    logFile << currLogData.clientIP << " " << currLogData.queryName << " " << currLogData.responseIP << std::endl;
-                }
-                // server was not found or domain name did not match
-                else
-                {
-                    if (args.domain_name != currLogData.queryName) 
-                    {
-                        queryMessage.header.QR = 1;
-                        queryMessage.header.RCODE = DNSRcode::NAME_ERROR;
-                        queryMessage.answers.clear();
-                        queryMessage.header.ANCOUNT = 0;
-                        queryMessage.header.NSCOUNT = 0;
-                        queryMessage.header.ARCOUNT = 0;
-                        auto serializedResponse = queryMessage.serialize();
-                        sendto(socket, serializedResponse.data(), serializedResponse.size(), 0, (struct sockaddr*)&client_addr, client_addr_len);
-                        logFile << currLogData.clientIP << " " << currLogData.queryName << " " << currLogData.responseIP << std::endl;
-                    }
-                    // wasn't able to find a server for this client
-                    else if (closestServer.type == "")
-                    {
-                        queryMessage.header.QR = 1;
-                        queryMessage.header.RCODE = DNSRcode::NO_ERROR;
-                        auto serializedResponse = queryMessage.serialize();
-                        sendto(socket, serializedResponse.data(), serializedResponse.size(), 0, (struct sockaddr*)&client_addr, client_addr_len);
-                    }
-                }
+    Answers answers;
+    answers.domain_name = args.domain_name;
+    // check to use RR or Geological and load the corresponding files
+    //Case 1: run with RR mode
+    if (args.round_robin_file_name != "" && args.topology_file_name == "") 
+    {
+        loadRRFile(args.round_robin_file_name, answers.RoundRobinIPs);
+        for (const std::string &ip : answers.RoundRobinIPs)
+        {
+            answers.templates.push_back(buildResponseTemplate(args.domain_name, ip));
+        }
+    } 
+    // Case 2: run with geolocation mode
+    else if (args.topology_file_name != "" && args.round_robin_file_name == "") 
+    {
+        Graph graph;
+        loadTopology(args.topology_file_name, graph);
+        // a query is a single lookup from here on
+        std::unordered_map<std::string, size_t> templateOf;
+        for (const auto &[client, serverIP] : computeClosestServers(graph))
+        {
+            auto [found, added] = templateOf.try_emplace(serverIP, answers.templates.size());
+            if (added)
+            {
+                answers.templates.push_back(buildResponseTemplate(args.domain_name, serverIP));
             }
+            answers.closestServers[client] = found->second;
         }
+        answers.geolocation = true;
+    }
+    else
+    {
+        logFile.close();
+        return 0;
     }
 
+    if (args.threads <= 0)
+    {
+        args.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // the first thread is the main one, the rest each get their own socket on the same port
+    std::vector<std::thread> threads;
+    for (int i = 1; i < args.threads; i++)
+    {
+        threads.emplace_back(serveQueries, std::cref(args), std::ref(answers));
+    }
+    serveQueries(args, answers);
+
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
     logFile.close();
-    //close(socket);
 
     return 0;
 }
@@ -0,0 +1,538 @@
+#include <string>
+#include <iostream>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include "EventLoop.h"
+#include "HttpParser.h"
+
+class Argument
+{
+public:
+    std::string host = "127.0.0.1";
+    int port = 8000;
+    std::string content_path = "./www";
+    int preload_mb = 0;
+    int workers = 1;
+};
+
+// a file kept in memory, with the header of its 200 response already built
+class PreloadedFile
+{
+public:
+    std::string header;
+    std::string body;
+};
+
+// the response being sent on a connection
+class Response
+{
+public:
+    std::string header;
+    size_t headerSent = 0;
+    const std::string *memoryBody = nullptr; // preloaded body, or
+    int fileFd = -1;                         // a file sent with sendfile()
+    off_t fileOffset = 0;
+    size_t bodyLeft = 0;
+    bool closeAfter = false;
+};
+
+// one browser or proxy connection
+class Connection
+{
+public:
+    std::vector<char> received;
+    bool sending = false;
+    Response response;
+};
+
+const int STATUS_ERROR = -1;
+const int MAX_BUFFER_SIZE = 16 * 1024;
+// a request header larger than this is refused
+const size_t MAX_HEADER_SIZE = 64 * 1024;
+
+// files loaded at start (--preload), read-only afterwards and shared by all workers
+std::unordered_map<std::string, PreloadedFile> preloaded;
+std::string contentRoot;
+
+// per worker
+thread_local std::vector<std::unique_ptr<Connection>> connections;
+
+// Function to parse the command line arguments
+void parsingArgument(int argc, char *argv[], Argument &args)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--host") == 0)
+            args.host = argv[++i];
+        else if (strcmp(argv[i], "--port") == 0)
+            args.port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--content-path") == 0)
+            args.content_path = argv[++i];
+        else if (strcmp(argv[i], "--preload") == 0)
+            args.preload_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--workers") == 0)
+            args.workers = atoi(argv[++i]);
+        else
+        {
+            std::cerr << "Unknown argument " << argv[i] << std::endl;
+            exit(1);
+        }
+    }
+}
+
+// same types Python's http.server picks for the content
+const char *contentTypeOf(const std::string &path)
+{
+    static const std::pair<const char *, const char *> TYPES[] = {
+        {".ts", "video/mp2t"},
+        {".m3u8", "application/vnd.apple.mpegurl"},
+        {".html", "text/html"},
+        {".js", "text/javascript"},
+        {".jpg", "image/jpeg"},
+        {".png", "image/png"},
+        {".css", "text/css"},
+    };
+    for (const auto &[extension, type] : TYPES)
+    {
+        if (path.ends_with(extension))
+        {
+            return type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+// status line and headers; the players must never cache, and the content is fetched cross-origin
+std::string responseHeader(int status, const char *reason, const char *contentType, size_t length, bool keepAlive)
+{
+    std::string header = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n";
+    header += "Server: origin\r\n";
+    header += "Content-Type: ";
+    header += contentType;
+    header += "\r\nContent-Length: " + std::to_string(length) + "\r\n";
+    header += "Cache-Control: no-store, no-cache, must-revalidate\r\n";
+    header += "Access-Control-Allow-Origin: *\r\n";
+    header += "Access-Control-Allow-Methods: *\r\n";
+    header += "Access-Control-Allow-Headers: *\r\n";
+    if (!keepAlive)
+    {
+        header += "Connection: close\r\n";
+    }
+    header += "\r\n";
+    return header;
+}
+
+// segment number of a chunk, 0 for anything else, e.g. charge_240p_0037.ts -> 37
+size_t segmentNumberOf(const std::string &path)
+{
+    size_t lastUnderscore = path.rfind('_');
+    if (!path.ends_with(".ts") || lastUnderscore == std::string::npos)
+    {
+        return 0;
+    }
+    return strtoul(path.c_str() + lastUnderscore + 1, nullptr, 10);
+}
+
+// Load playlists and the first segments of every video into memory, up to budget bytes: every
+// player starts at the beginning, so early segments are the ones most asked for
+void preload(size_t budget)
+{
+    std::vector<std::pair<size_t, std::filesystem::path>> files;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(contentRoot))
+    {
+        std::string name = entry.path().string();
+        if (entry.is_regular_file() && (name.ends_with(".ts") || name.ends_with(".m3u8")))
+        {
+            files.push_back({segmentNumberOf(name), entry.path()});
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    size_t used = 0;
+    for (const auto &[segment, path] : files)
+    {
+        size_t size = std::filesystem::file_size(path);
+        if (used + size > budget)
+        {
+            break;
+        }
+        std::ifstream file(path, std::ios::binary);
+        PreloadedFile &entry = preloaded["/" + std::filesystem::relative(path, contentRoot).string()];
+        entry.body.resize(size);
+        file.read(entry.body.data(), size);
+        entry.header = responseHeader(200, "OK", contentTypeOf(path.string()), entry.body.size(), true);
+        used += size;
+    }
+    std::cout << "Preloaded " << preloaded.size() << " files, " << used / (1024 * 1024) << " MB" << std::endl;
+}
+
+// Function to create a socket for listening; with several workers each gets its own socket on the
+// same port and the kernel spreads connections over them
+int createMainSocket(const std::string &host, int port)
+{
+    int mainSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (mainSocket < 0)
+    {
+        perror("socket");
+        exit(1);
+    }
+    int opt = 1;
+    setsockopt(mainSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(mainSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        std::cerr << "setsockopt SO_REUSEPORT failed" << std::endl;
+        exit(1);
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    if (bind(mainSocket, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        std::cerr << "Failed to bind the socket on port " << port << std::endl;
+        exit(1);
+    }
+    if (listen(mainSocket, SOMAXCONN) < 0)
+    {
+        std::cerr << "listen error" << std::endl;
+        exit(1);
+    }
+    return mainSocket;
+}
+
+void closeConnection(EventLoop &loop, int s)
+{
+    Connection *conn = connections[s].get();
+    if (conn->response.fileFd != STATUS_ERROR)
+    {
+        close(conn->response.fileFd);
+    }
+    loop.remove(s);
+    close(s);
+    connections[s].reset();
+}
+
+// the file a request path names under the content root, empty if it leaves it
+std::string resolvePath(std::string_view uri)
+{
+    std::string path(uri.substr(0, uri.find_first_of("?#")));
+    if (path.empty() || path[0] != '/' || path.find("/..") != std::string::npos)
+    {
+        return "";
+    }
+    if (path.back() == '/')
+    {
+        path += "index.html";
+    }
+    return path;
+}
+
+// Set up the response to one request: from memory when preloaded, otherwise the file is opened
+// and its body goes out with sendfile()
+void startResponse(Connection &conn, const HttpRequest &request)
+{
+    Response &response = conn.response;
+    response = Response();
+    response.closeAfter = !request.keepAlive;
+    bool head = request.method == "HEAD";
+
+    if (request.method != "GET" && !head)
+    {
+        static const std::string BODY = "Method not allowed\n";
+        response.header = responseHeader(501, "Unsupported method", "text/plain", BODY.size(), request.keepAlive);
+        response.memoryBody = &BODY;
+        response.bodyLeft = BODY.size();
+        return;
+    }
+
+    std::string path = resolvePath(request.uri);
+    auto cached = preloaded.find(path);
+    if (cached != preloaded.end())
+    {
+        response.header = request.keepAlive ? cached->second.header
+                                            : responseHeader(200, "OK", contentTypeOf(path), cached->second.body.size(), false);
+        response.memoryBody = &cached->second.body;
+        response.bodyLeft = head ? 0 : cached->second.body.size();
+        return;
+    }
+
+    int fd = path.empty() ? STATUS_ERROR : open((contentRoot + path).c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd == STATUS_ERROR || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        if (fd != STATUS_ERROR)
+        {
+            close(fd);
+        }
+        static const std::string BODY = "File not found\n";
+        response.header = responseHeader(404, "File not found", "text/plain", BODY.size(), request.keepAlive);
+        response.memoryBody = &BODY;
+        response.bodyLeft = head ? 0 : BODY.size();
+        return;
+    }
+    response.header = responseHeader(200, "OK", contentTypeOf(path), info.st_size, request.keepAlive);
+    if (head)
+    {
+        close(fd);
+        return;
+    }
+    response.fileFd = fd;
+    response.bodyLeft = info.st_size;
+}
+
+// Send what the socket takes of the current response. Returns false once it would block; true when
+// the response is complete.
+bool pumpResponse(int s, Response &response)
+{
+    // header and an in-memory body leave together
+    while (response.headerSent < response.header.size() || (response.memoryBody != nullptr && response.bodyLeft > 0))
+    {
+        iovec iov[2];
+        int count = 0;
+        if (response.headerSent < response.header.size())
+        {
+            iov[count++] = {response.header.data() + response.headerSent, response.header.size() - response.headerSent};
+        }
+        if (response.memoryBody != nullptr && response.bodyLeft > 0)
+        {
+            iov[count++] = {(void *)(response.memoryBody->data() + response.memoryBody->size() - response.bodyLeft), response.bodyLeft};
+        }
+        ssize_t n = writev(s, iov, count);
+        if (n == STATUS_ERROR)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        size_t headerPart = std::min((size_t)n, response.header.size() - response.headerSent);
+        response.headerSent += headerPart;
+        if (response.memoryBody != nullptr)
+        {
+            response.bodyLeft -= n - headerPart;
+        }
+    }
+
+    // a file body goes from the page cache to the socket without a copy through user space
+    while (response.fileFd != STATUS_ERROR && response.bodyLeft > 0)
+    {
+        ssize_t n = sendfile(s, response.fileFd, &response.fileOffset, response.bodyLeft);
+        if (n == STATUS_ERROR)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (n == 0)
+        {
+            // the file shrank underneath us, the connection cannot be framed any more
+            response.closeAfter = true;
+            break;
+        }
+        response.bodyLeft -= n;
+    }
+    if (response.fileFd != STATUS_ERROR)
+    {
+        close(response.fileFd);
+        response.fileFd = STATUS_ERROR;
+    }
+    return true;
+}
+
+// Answer the requests waiting in a connection's receive buffer, one after the other, until the
+// socket is full. Closes the connection when done with it.
+void serveConnection(EventLoop &loop, int s)
+{
+    Connection &conn = *connections[s];
+    while (true)
+    {
+        if (conn.sending)
+        {
+            if (!pumpResponse(s, conn.response))
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    loop.setWriteInterest(s, true);
+                    return;
+                }
+                closeConnection(loop, s);
+                return;
+            }
+            conn.sending = false;
+            loop.setWriteInterest(s, false);
+            if (conn.response.closeAfter)
+            {
+                closeConnection(loop, s);
+                return;
+            }
+        }
+
+        HttpRequest request;
+        ParseResult result = parseRequest(std::string_view(conn.received.data(), conn.received.size()), request);
+        if (result == ParseResult::Error || (result == ParseResult::Incomplete && conn.received.size() > MAX_HEADER_SIZE))
+        {
+            closeConnection(loop, s);
+            return;
+        }
+        if (result == ParseResult::Incomplete)
+        {
+            return;
+        }
+        startResponse(conn, request);
+        conn.received.erase(conn.received.begin(), conn.received.begin() + request.length);
+        conn.sending = true;
+    }
+}
+
+// read what a connection sent, false once it is drained or closed
+bool receive(EventLoop &loop, int s)
+{
+    Connection &conn = *connections[s];
+    // pipelined requests queue up behind a response only so far, the rest waits in the socket until
+    // the response is out, so a client that sends without reading cannot grow the buffer unbounded
+    if (conn.sending && conn.received.size() > MAX_HEADER_SIZE)
+    {
+        return false;
+    }
+    size_t used = conn.received.size();
+    conn.received.resize(used + MAX_BUFFER_SIZE);
+    ssize_t n = recv(s, conn.received.data() + used, MAX_BUFFER_SIZE, 0);
+    conn.received.resize(used + std::max(n, (ssize_t)0));
+    if (n == STATUS_ERROR && errno == EINTR)
+    {
+        return true;
+    }
+    if (n == STATUS_ERROR && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return false;
+    }
+    if (n <= 0)
+    {
+        closeConnection(loop, s);
+        return false;
+    }
+    // a pipelined request waits until the response ahead of it is out
+    if (!conn.sending)
+    {
+        serveConnection(loop, s);
+    }
+    return connections[s] != nullptr;
+}
+
+void runWorker(const Argument &args)
+{
+    EventLoop loop;
+    int mainSocket = createMainSocket(args.host, args.port);
+    loop.add(mainSocket);
+
+    while (true)
+    {
+        for (epoll_event &event : loop.wait())
+        {
+            int s = event.data.fd;
+            if (s == mainSocket)
+            {
+                int client;
+                while ((client = accept4(mainSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != STATUS_ERROR)
+                {
+                    int one = 1;
+                    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    if ((size_t)client >= connections.size())
+                    {
+                        connections.resize(std::max((size_t)client + 1, connections.size() * 2));
+                    }
+                    connections[client] = std::make_unique<Connection>();
+                    loop.add(client);
+                }
+                continue;
+            }
+            if ((size_t)s >= connections.size() || connections[s] == nullptr)
+            {
+                continue;
+            }
+
+            bool resumed = false;
+            if (event.events & EPOLLOUT)
+            {
+                serveConnection(loop, s);
+                if (connections[s] == nullptr)
+                {
+                    continue;
+                }
+                // reading may have stopped while the response was out, no new edge comes for that data
+                resumed = !connections[s]->sending;
+            }
+            if (resumed || (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+            {
+                while (receive(loop, s))
+                {
+                }
+            }
+        }
+    }
+}
+
+// every connection costs a descriptor, so lift the soft limit as far as allowed
+void raiseFileLimit()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Argument args;
+    parsingArgument(argc, argv, args);
+    raiseFileLimit();
+
+    contentRoot = args.content_path;
+    while (contentRoot.size() > 1 && contentRoot.back() == '/')
+    {
+        contentRoot.pop_back();
+    }
+    if (!std::filesystem::is_directory(contentRoot))
+    {
+        std::cerr << "Content path " << contentRoot << " is not a directory" << std::endl;
+        exit(1);
+    }
+    if (args.preload_mb > 0)
+    {
+        preload((size_t)args.preload_mb * 1024 * 1024);
+    }
+
+    // one worker per core when asked for 0
+    if (args.workers <= 0)
+    {
+        args.workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::cout << "Origin running on " << args.host << ":" << args.port << std::endl;
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < args.workers; i++)
+    {
+        workers.emplace_back(runWorker, std::cref(args));
+    }
+    runWorker(args);
+    return 0;
+}